@@ -0,0 +1,359 @@
+// Measures the catalog, search and install paths of faf against FixtureServer,
+// without touching the network or the user's own cache, config and fonts.
+//
+//   faf_bench [--iterations N] [--only <group>] [--json]
+//
+// The groups are catalog, search, install and match. match compares the substring
+// matcher with the per-name lowercase-and-find loop it replaced, and needs no server.
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/couriers/catalog_cache.h"
+#include "../src/couriers/downloader.h"
+#include "../src/couriers/fontsquirrel.h"
+#include "../src/couriers/google.h"
+#include "../src/couriers/matcher.h"
+#include "../src/external/nlohmann/json.hpp"
+#include "fixture_server.h"
+
+namespace {
+using json = nlohmann::json;
+using faf::bench::FixtureServer;
+
+const size_t CATALOG_SIZES[] = {1000, 10000, 100000};
+const size_t QUERY_COUNTS[] = {100, 1000};
+const size_t INSTALL_COUNTS[] = {10, 100};
+// Catalog the searches and installs run against
+constexpr size_t SEARCH_CATALOG = 10000;
+constexpr size_t INSTALL_JOBS = 4;
+
+// Queries that match something in every catalog, and nothing
+const std::vector<std::string> ANY = {"a"};
+const std::vector<std::string> NOTHING = {"zzzz"};
+
+struct result {
+  std::string name;
+  std::vector<double> ms;
+};
+
+std::filesystem::path home;
+
+void write_config(const FixtureServer &server, size_t families) {
+  const std::string size = std::to_string(families);
+  json cfg = {{"google", {{"enabled", true},
+                          {"api_key", "bench"},
+                          {"api_url", server.url("/google/" + size)}}},
+              {"fontsquirrel", {{"enabled", true},
+                                {"api_url", server.url("/fontsquirrel/" + size)},
+                                {"download_url", server.url("/files/")}}}};
+
+  std::filesystem::create_directories(home / ".config/faf");
+  std::ofstream(home / ".config/faf/config.json") << cfg.dump(2);
+}
+
+void clear_cache() {
+  std::filesystem::remove_all(home / ".cache/faf");
+  std::filesystem::create_directories(home / ".cache/faf");
+}
+
+void clear_fonts() {
+  std::filesystem::remove_all(home / ".fonts");
+  std::filesystem::remove_all(home / ".local/share/faf");
+}
+
+// Runs `setup` untimed and `body` timed, `iterations` times
+result measure(const std::string &name, int iterations, const std::function<void()> &setup,
+               const std::function<void()> &body) {
+  result r{name, {}};
+  for (int i = 0; i < iterations; i++) {
+    setup();
+    const auto start = std::chrono::steady_clock::now();
+    body();
+    r.ms.push_back(std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count());
+  }
+  std::sort(r.ms.begin(), r.ms.end());
+  return r;
+}
+
+double median(const std::vector<double> &sorted) {
+  const size_t n = sorted.size();
+  return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+// Prefixes of the synthetic family names, 2 to 5 characters long
+std::vector<std::string> make_queries(size_t count, size_t families) {
+  std::vector<std::string> queries;
+  for (size_t i = 0; i < count; i++) {
+    const std::string name = FixtureServer::family_name((i * 7919) % families);
+    queries.push_back(name.substr(0, 2 + i % 4));
+  }
+  return queries;
+}
+
+std::string label(size_t n) {
+  return n >= 1000 ? std::to_string(n / 1000) + "k" : std::to_string(n);
+}
+
+// Substring search over the names of a 100k catalog, as the packed keys of the
+// index and as the separate names the couriers used to loop over
+void match_benchmarks(int iterations, std::vector<result> &results) {
+  constexpr size_t FAMILIES = 100000;
+  constexpr size_t QUERIES = 100;
+
+  std::vector<std::string> names;
+  std::string keys;
+  for (size_t i = 0; i < FAMILIES; i++) {
+    names.push_back(FixtureServer::family_name(i));
+    for (char c : names.back()) {
+      keys += std::tolower(static_cast<unsigned char>(c));
+    }
+    keys += '\n';
+  }
+
+  // Pieces from the middle of names, with some that match nothing
+  std::vector<std::string> queries;
+  for (size_t i = 0; i < QUERIES; i++) {
+    const std::string name = FixtureServer::family_name((i * 7919) % FAMILIES);
+    std::string query = name.substr(1 + i % 3, 3 + i % 3);
+    for (auto &c : query) {
+      c = std::tolower(static_cast<unsigned char>(c));
+    }
+    queries.push_back(i % 10 == 0 ? query + "q" : query);
+  }
+
+  size_t expected = 0;
+  results.push_back(measure("match " + std::to_string(QUERIES) + " queries 100k, tolower+find",
+                            iterations, []() {}, [&]() {
+                              expected = 0;
+                              for (const auto &query : queries) {
+                                for (const auto &name : names) {
+                                  std::string lower = name;
+                                  std::transform(lower.begin(), lower.end(), lower.begin(),
+                                                 ::tolower);
+                                  expected += lower.find(query) != std::string::npos;
+                                }
+                              }
+                            }));
+
+  const faf::Matcher::ISA isas[] = {faf::Matcher::ISA::SCALAR, faf::Matcher::ISA::SSE2,
+                                    faf::Matcher::ISA::AVX2};
+  for (auto isa : isas) {
+    if (isa > faf::Matcher::detect()) {
+      continue;
+    }
+
+    size_t found = 0;
+    results.push_back(measure("match " + std::to_string(QUERIES) + " queries 100k, " +
+                                  faf::Matcher::name(isa),
+                              iterations, []() {}, [&]() {
+                                found = 0;
+                                for (const auto &query : queries) {
+                                  size_t pos = 0;
+                                  while ((pos = faf::Matcher::find(keys, query, pos, isa)) !=
+                                         std::string::npos) {
+                                    found++;
+                                    pos = keys.find('\n', pos) + 1;
+                                  }
+                                }
+                              }));
+
+    if (found != expected) {
+      std::cerr << "Error: " << faf::Matcher::name(isa) << " found " << found
+                << " names, expected " << expected << std::endl;
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int iterations = 5;
+  bool as_json = false;
+  std::string only;
+
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--iterations") && i + 1 < argc) {
+      iterations = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--only") && i + 1 < argc) {
+      only = argv[++i];
+    } else if (!std::strcmp(argv[i], "--json")) {
+      as_json = true;
+    } else {
+      std::cerr << "Usage: faf_bench [--iterations N] [--only <group>] [--json]" << std::endl;
+      return 1;
+    }
+  }
+
+  const auto group = [&only](const char *name) { return only.empty() || only == name; };
+
+  // Everything faf reads and writes goes below a throwaway home
+  char tmpl[] = "/tmp/faf-bench-XXXXXX";
+  if (!mkdtemp(tmpl)) {
+    std::cerr << "Error: could not create a temporary directory" << std::endl;
+    return 1;
+  }
+  home = tmpl;
+  setenv("HOME", tmpl, 1);
+
+  FixtureServer server;
+  if (!server.start()) {
+    std::cerr << "Error: could not start the fixture server" << std::endl;
+    return 1;
+  }
+
+  std::vector<result> results;
+  const auto noop = []() {};
+
+  for (size_t families : CATALOG_SIZES) {
+    if (!group("catalog")) {
+      break;
+    }
+
+    write_config(server, families);
+    const std::string size = label(families);
+
+    // Fetched and parsed while it downloads, the first request also generates it
+    faf::CatalogCache::configure(0, faf::CACHE_POLICY::REFRESH);
+    faf::Google warmup;
+    warmup.search(ANY);
+
+    results.push_back(measure("google catalog fetch " + size, iterations, clear_cache, []() {
+      faf::Google gfonts;
+      gfonts.search(ANY);
+    }));
+    results.push_back(
+        measure("fontsquirrel catalog fetch " + size, iterations, clear_cache, []() {
+          faf::FontSquirrel fontsquirrel;
+          fontsquirrel.search(ANY);
+        }));
+
+    // From the cached JSON, as after a version change of the index
+    faf::Google cached;
+    cached.search(ANY);
+    faf::CatalogCache::configure(0, faf::CACHE_POLICY::OFFLINE);
+
+    results.push_back(measure("google catalog compile " + size, iterations, noop,
+                              [&cached]() { cached.rebuild_index(); }));
+    results.push_back(measure("google catalog open " + size, iterations, noop,
+                              [&cached]() { cached.search(NOTHING); }));
+  }
+
+  // The searches and installs share one catalog
+  write_config(server, SEARCH_CATALOG);
+  faf::CatalogCache::configure(0, faf::CACHE_POLICY::REFRESH);
+  clear_cache();
+  faf::Google gfonts;
+  if (group("search") || group("install")) {
+    gfonts.search(ANY);
+    faf::FontSquirrel fontsquirrel;
+    fontsquirrel.search(ANY);
+  }
+  faf::CatalogCache::configure(0, faf::CACHE_POLICY::OFFLINE);
+
+  for (size_t count : QUERY_COUNTS) {
+    if (!group("search")) {
+      break;
+    }
+    const auto queries = make_queries(count, SEARCH_CATALOG);
+    const std::string name = std::to_string(count) + " queries " + label(SEARCH_CATALOG);
+
+    results.push_back(measure("google search " + name, iterations, noop, [&queries]() {
+      faf::Google gfonts;
+      gfonts.search(queries);
+    }));
+    results.push_back(measure("fontsquirrel search " + name, iterations, noop, [&queries]() {
+      faf::FontSquirrel fontsquirrel;
+      fontsquirrel.search(queries);
+    }));
+    results.push_back(measure("google search --contains " + name, iterations, noop,
+                              [&queries]() {
+                                faf::Google gfonts;
+                                gfonts.set_contains(true);
+                                gfonts.search(queries);
+                              }));
+  }
+
+  // Plenty of files to pick the installs from, they point into `gfonts`
+  std::vector<faf::font_props> fonts;
+  if (group("install")) {
+    for (const auto &matches : gfonts.search(make_queries(200, SEARCH_CATALOG))) {
+      fonts.insert(fonts.end(), matches.begin(), matches.end());
+    }
+  }
+
+  for (size_t count : INSTALL_COUNTS) {
+    if (!group("install")) {
+      break;
+    }
+    const std::vector<faf::font_props> batch(fonts.begin(),
+                                             fonts.begin() + std::min(count, fonts.size()));
+    const std::string name = "install " + std::to_string(batch.size()) + " files";
+    const std::filesystem::path store = home / "store";
+
+    results.push_back(measure(
+        name, iterations,
+        [&store]() {
+          clear_fonts();
+          std::filesystem::remove_all(store);
+        },
+        [&batch, &store]() {
+          faf::Downloader downloader(false, INSTALL_JOBS);
+          downloader.set_store_dir(store);
+          downloader.download(batch);
+        }));
+
+    // The store already holds every file, nothing is downloaded
+    results.push_back(measure(name + " from store", iterations, clear_fonts,
+                              [&batch, &store]() {
+                                faf::Downloader downloader(false, INSTALL_JOBS);
+                                downloader.set_store_dir(store);
+                                downloader.download(batch);
+                              }));
+  }
+
+  if (group("match")) {
+    match_benchmarks(iterations, results);
+  }
+
+  server.stop();
+  std::filesystem::remove_all(home);
+
+  if (as_json) {
+    json out = json::array();
+    for (const auto &r : results) {
+      out.push_back({{"name", r.name},
+                     {"iterations", r.ms.size()},
+                     {"median_ms", median(r.ms)},
+                     {"min_ms", r.ms.front()},
+                     {"max_ms", r.ms.back()}});
+    }
+    std::cout << out.dump(2) << std::endl;
+    return 0;
+  }
+
+  std::cout << "\n"
+            << std::left << std::setw(44) << "benchmark" << std::right << std::setw(12)
+            << "median ms" << std::setw(12) << "min ms" << std::setw(12) << "max ms"
+            << "\n";
+  for (const auto &r : results) {
+    std::cout << std::left << std::setw(44) << r.name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(12) << median(r.ms) << std::setw(12)
+              << r.ms.front() << std::setw(12) << r.ms.back() << "\n";
+  }
+
+  return 0;
+}
@@ -0,0 +1,261 @@
+#include "fixture_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+
+#include "../src/external/nlohmann/json.hpp"
+
+namespace {
+using json = nlohmann::json;
+
+constexpr size_t FONT_SIZE = 64 * 1024;
+
+const char *const SYLLABLES[] = {"ba", "ko", "ri", "sa", "ne", "lu", "mo", "ta",
+                                 "vi", "de", "pa", "zo", "gi", "fe", "ru", "no"};
+const char *const STYLES[] = {"Sans", "Serif", "Mono", "Display", "Slab", "Script"};
+const char *const WEIGHTS[] = {"100", "100italic", "200", "200italic", "300",
+                               "300italic", "regular", "italic", "500", "500italic",
+                               "600", "600italic", "700", "700italic", "800",
+                               "800italic", "900", "900italic"};
+
+// Small deterministic generator, the data must not change between runs
+uint32_t next(uint32_t &state) {
+  state = state * 1664525u + 1013904223u;
+  return state >> 8;
+}
+
+bool send_all(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+} // namespace
+
+namespace faf::bench {
+
+FixtureServer::FixtureServer() = default;
+
+FixtureServer::~FixtureServer() { stop(); }
+
+bool FixtureServer::start() {
+  listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    return false;
+  }
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  socklen_t size = sizeof(addr);
+  if (::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      ::listen(listen_fd, 64) != 0 ||
+      ::getsockname(listen_fd, reinterpret_cast<sockaddr *>(&addr), &size) != 0) {
+    ::close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+  port = ntohs(addr.sin_port);
+
+  acceptor = std::thread([this]() {
+    while (true) {
+      int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0) {
+        break;
+      }
+      std::lock_guard<std::mutex> guard(clients_mutex);
+      clients.push_back(fd);
+      connections.emplace_back([this, fd]() { serve(fd); });
+    }
+  });
+
+  return true;
+}
+
+void FixtureServer::stop() {
+  if (listen_fd < 0) {
+    return;
+  }
+
+  ::shutdown(listen_fd, SHUT_RDWR);
+  acceptor.join();
+  ::close(listen_fd);
+  listen_fd = -1;
+
+  std::vector<std::thread> finished;
+  {
+    std::lock_guard<std::mutex> guard(clients_mutex);
+    for (int fd : clients) {
+      ::shutdown(fd, SHUT_RDWR);
+    }
+    finished.swap(connections);
+  }
+  for (auto &connection : finished) {
+    connection.join();
+  }
+  for (int fd : clients) {
+    ::close(fd);
+  }
+  clients.clear();
+}
+
+std::string FixtureServer::url(const std::string &path) const {
+  return "http://127.0.0.1:" + std::to_string(port) + path;
+}
+
+std::string FixtureServer::family_name(size_t i) {
+  uint32_t state = static_cast<uint32_t>(i) * 2654435761u + 1;
+  std::string name;
+  const size_t syllables = 2 + next(state) % 2;
+  for (size_t s = 0; s < syllables; s++) {
+    name += SYLLABLES[next(state) % 16];
+  }
+  name[0] = name[0] - 'a' + 'A';
+
+  // The number keeps the names unique however many are generated
+  return name + " " + STYLES[next(state) % 6] + " " + std::to_string(i);
+}
+
+void FixtureServer::serve(int fd) {
+  std::string buffer;
+  char chunk[4096];
+
+  while (true) {
+    size_t end;
+    while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+      ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0) {
+        return;
+      }
+      buffer.append(chunk, n);
+    }
+
+    const std::string request = buffer.substr(0, end);
+    buffer.erase(0, end + 4);
+
+    // "GET /path?query HTTP/1.1"
+    const size_t start = request.find(' ') + 1;
+    std::string path = request.substr(start, request.find(' ', start) - start);
+    path = path.substr(0, path.find('?'));
+
+    bool found = false;
+    const std::string &content = body(path, found);
+
+    std::string head = found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n";
+    head += "Content-Length: " + std::to_string(found ? content.size() : 0) + "\r\n\r\n";
+
+    if (!send_all(fd, head) || (found && !send_all(fd, content))) {
+      return;
+    }
+  }
+}
+
+const std::string &FixtureServer::body(const std::string &request_path, bool &found) {
+  // Every file has the same content, only the URL differs
+  const std::string path = request_path.starts_with("/files/") ? "/files/" : request_path;
+
+  std::lock_guard<std::mutex> guard(bodies_mutex);
+
+  auto it = bodies.find(path);
+  if (it != bodies.end()) {
+    found = true;
+    return it->second;
+  }
+
+  std::string content;
+  if (path.starts_with("/google/")) {
+    content = google_catalog(std::strtoul(path.c_str() + 8, nullptr, 10), url("/files/"));
+  } else if (path.starts_with("/fontsquirrel/")) {
+    content = fontsquirrel_catalog(std::strtoul(path.c_str() + 14, nullptr, 10));
+  } else if (path == "/files/") {
+    content = font_file();
+  } else {
+    static const std::string none;
+    found = false;
+    return none;
+  }
+
+  found = true;
+  return bodies.emplace(path, std::move(content)).first->second;
+}
+
+std::string FixtureServer::google_catalog(size_t families, const std::string &files_url) {
+  json items = json::array();
+  uint32_t state = 42;
+
+  for (size_t i = 0; i < families; i++) {
+    const std::string family = family_name(i);
+    std::string slug = family;
+    for (auto &c : slug) {
+      c = c == ' ' ? '-' : std::tolower(static_cast<unsigned char>(c));
+    }
+
+    json variants = json::array();
+    json files = json::object();
+    const size_t count = 1 + next(state) % 18;
+    for (size_t v = 0; v < count; v++) {
+      variants.push_back(WEIGHTS[v]);
+      files[WEIGHTS[v]] = files_url + slug + "-" + WEIGHTS[v] + ".ttf";
+    }
+
+    // Shaped like the real thing, including the members faf doesn't keep
+    items.push_back({{"kind", "webfonts#webfont"},
+                     {"family", family},
+                     {"variants", variants},
+                     {"subsets", {"latin", "latin-ext"}},
+                     {"version", "v" + std::to_string(1 + next(state) % 30)},
+                     {"lastModified", "2024-01-01"},
+                     {"files", files},
+                     {"category", "sans-serif"},
+                     {"menu", files_url + slug + "-menu.ttf"}});
+  }
+
+  return json({{"kind", "webfonts#webfontList"}, {"items", items}}).dump();
+}
+
+std::string FixtureServer::fontsquirrel_catalog(size_t families) {
+  json list = json::array();
+
+  for (size_t i = 0; i < families; i++) {
+    const std::string family = family_name(i);
+    std::string slug = family;
+    for (auto &c : slug) {
+      c = c == ' ' ? '-' : std::tolower(static_cast<unsigned char>(c));
+    }
+
+    list.push_back({{"id", std::to_string(i)},
+                    {"family_name", family},
+                    {"is_monocode", "N"},
+                    {"foundry_name", "Bench Foundry"},
+                    {"font_filename", slug + "-Regular.otf"},
+                    {"family_urlname", slug},
+                    {"family_count", "1"},
+                    {"classification", "Sans"}});
+  }
+
+  return list.dump();
+}
+
+std::string FixtureServer::font_file() {
+  std::string data(FONT_SIZE, '\0');
+  uint32_t state = 7;
+  for (auto &c : data) {
+    c = static_cast<char>(next(state));
+  }
+  return data;
+}
+
+} // namespace faf::bench
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace faf::bench {
+
+// Stand-in for the font APIs on 127.0.0.1, serving synthetic data over plain
+// HTTP/1.1 with keep-alive:
+//
+//   /google/<n>          Google Fonts catalog with n families
+//   /fontsquirrel/<n>    FontSquirrel catalog with n families
+//   /files/<name>        a 64 KiB font file
+//
+// Everything is generated from fixed seeds, so every run serves the same bytes.
+class FixtureServer {
+public:
+  FixtureServer();
+  ~FixtureServer();
+
+  FixtureServer(const FixtureServer &) = delete;
+  FixtureServer &operator=(const FixtureServer &) = delete;
+
+  // Listens on a free port, false if that failed
+  bool start();
+  void stop();
+
+  std::string url(const std::string &path) const;
+
+  // Name of family `i` in the synthetic catalogs
+  static std::string family_name(size_t i);
+
+private:
+  void serve(int fd);
+  const std::string &body(const std::string &path, bool &found);
+
+  static std::string google_catalog(size_t families, const std::string &files_url);
+  static std::string fontsquirrel_catalog(size_t families);
+  static std::string font_file();
+
+  int listen_fd = -1;
+  int port = 0;
+  std::thread acceptor;
+
+  std::mutex clients_mutex;
+  std::vector<int> clients;
+  std::vector<std::thread> connections;
+
+  std::mutex bodies_mutex;
+  // Generated bodies by path, built on first request
+  std::map<std::string, std::string> bodies;
+};
+
+} // namespace faf::bench
@@ -0,0 +1,229 @@
+#include "blob_store.h"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif // __linux__
+
+#include <sstream>
+
+#include "../sha256.h"
+#include "../util.h"
+
+namespace {
+
+// Makes `to` share `from`'s data without copying it, where the filesystem can
+bool reflink(const std::filesystem::path &from, const std::filesystem::path &to) {
+#if defined(__linux__) && defined(FICLONE)
+  int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    return false;
+  }
+  int out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out < 0) {
+    ::close(in);
+    return false;
+  }
+
+  bool ok = ioctl(out, FICLONE, in) == 0;
+  ::close(in);
+  ::close(out);
+  if (!ok) {
+    std::error_code ec;
+    std::filesystem::remove(to, ec);
+  }
+  return ok;
+#else
+  return false;
+#endif // __linux__
+}
+
+// Puts a copy of `from` at `to`, sharing its data where the filesystem can
+bool duplicate(const std::filesystem::path &from, const std::filesystem::path &to) {
+  if (reflink(from, to)) {
+    return true;
+  }
+  std::error_code ec;
+  return std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing,
+                                    ec);
+}
+
+// Whether a file in the store came from this user or root, and nobody else can
+// change it
+bool is_trusted(const struct stat &st) {
+  return (st.st_uid == getuid() || st.st_uid == 0) && !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+// Puts `from` at `to` as cheaply as possible: a hardlink, a reflink or a copy
+bool place(const std::filesystem::path &from, const std::filesystem::path &to) {
+  std::error_code ec;
+  std::filesystem::create_hard_link(from, to, ec);
+  return !ec || duplicate(from, to);
+}
+
+} // namespace
+
+namespace faf {
+
+BlobStore::BlobStore(const std::filesystem::path &root)
+    : root(root.empty() ? default_root() : root) {}
+
+std::filesystem::path BlobStore::default_root() {
+  const std::filesystem::path shared = "/var/cache/faf";
+  std::error_code ec;
+  std::filesystem::create_directories(shared / "blobs", ec);
+
+  return access((shared / "blobs").c_str(), W_OK) == 0 ? shared : Util::get_cache_dir();
+}
+
+std::string BlobStore::find(const std::string &url, const std::string &sha256) {
+  std::string hash = sha256;
+  if (hash.empty()) {
+    if (url.empty()) {
+      return "";
+    }
+    load_urls();
+    auto it = urls.find(url);
+    if (it == urls.end()) {
+      return "";
+    }
+    hash = it->second;
+  }
+
+  struct stat st;
+  if (::stat(blob_path(hash).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+    return "";
+  }
+
+  // The store may be shared with other users, so only blobs this user or root
+  // added, and nobody else can write to, are taken as named
+  if (!is_trusted(st) && Sha256::file(blob_path(hash)) != hash) {
+    return "";
+  }
+  return hash;
+}
+
+bool BlobStore::install(const std::string &sha256, const std::filesystem::path &path) {
+  std::filesystem::path tmp = path;
+  tmp += ".part";
+
+  std::error_code ec;
+  std::filesystem::remove(tmp, ec);
+  if (!place(blob_path(sha256), tmp)) {
+    return false;
+  }
+
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+bool BlobStore::add(const std::filesystem::path &path, const std::string &sha256,
+                    const std::string &url) {
+  const std::filesystem::path blob = blob_path(sha256);
+  std::error_code ec;
+  std::filesystem::create_directories(blob.parent_path(), ec);
+
+  if (!std::filesystem::exists(blob, ec)) {
+    // Published under its hash only once complete, like the installed files. It
+    // is a copy, so editing the installed file doesn't change other installs.
+    std::filesystem::path tmp = blob;
+    tmp += "." + std::to_string(getpid()) + ".tmp";
+    if (!duplicate(path, tmp)) {
+      return false;
+    }
+    std::filesystem::permissions(tmp,
+                                 std::filesystem::perms::owner_read |
+                                     std::filesystem::perms::group_read |
+                                     std::filesystem::perms::others_read,
+                                 ec);
+    std::filesystem::rename(tmp, blob, ec);
+    if (ec) {
+      std::filesystem::remove(tmp, ec);
+      return false;
+    }
+  }
+
+  if (url.empty()) {
+    return true;
+  }
+  load_urls();
+  auto it = urls.find(url);
+  if (it != urls.end() && it->second == sha256) {
+    return true;
+  }
+  urls[url] = sha256;
+
+  // Lines are appended in one write each, so concurrent installs don't mix. A
+  // map someone else put in this user's place is left alone.
+  int fd = ::open(urls_path(getuid()).c_str(),
+                  O_WRONLY | O_CREAT | O_APPEND | O_NOFOLLOW | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  const std::string line = sha256 + " " + url + "\n";
+  bool ok = fstat(fd, &st) == 0 && st.st_uid == getuid() &&
+            ::write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size());
+  ::close(fd);
+  return ok;
+}
+
+void BlobStore::load_urls() {
+  if (loaded) {
+    return;
+  }
+  loaded = true;
+
+  // Root's downloads are as good as this user's own, and this user's win
+  if (getuid() != 0) {
+    load_urls(urls_path(0));
+  }
+  load_urls(urls_path(getuid()));
+}
+
+void BlobStore::load_urls(const std::filesystem::path &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+
+  // Any user can put files in a shared store, so only maps of this user or root
+  // that nobody else can write to are read
+  struct stat st;
+  std::string data;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && is_trusted(st)) {
+    char buffer[16384];
+    ssize_t n;
+    while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+      data.append(buffer, n);
+    }
+  }
+  ::close(fd);
+
+  std::istringstream stream(data);
+  std::string line;
+  while (std::getline(stream, line)) {
+    size_t space = line.find(' ');
+    if (space == 64) {
+      // Later lines win, a URL can be served different files over time
+      urls[line.substr(space + 1)] = line.substr(0, space);
+    }
+  }
+}
+
+std::filesystem::path BlobStore::urls_path(uid_t uid) const {
+  return root / ("urls." + std::to_string(uid));
+}
+
+std::filesystem::path BlobStore::blob_path(const std::string &sha256) const {
+  return root / "blobs" / sha256;
+}
+
+} // namespace faf
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+namespace faf {
+
+// Content-addressed store of every font file faf downloaded, shared by all users
+// when /var/cache/faf/ is writable and kept in ~/.cache/faf/ otherwise.
+//
+// Files are stored read-only as `blobs/<sha256>`, copies of their own, and each
+// user's `urls.<uid>` maps the immutable URLs they downloaded from to their
+// hashes, one "<sha256> <url>" line each. A user only takes their own map and
+// root's, so nobody else can point a URL at a file of their choosing. Files from
+// other URLs are only found by their hash.
+// Installs of a known file are hardlinked or reflinked from the store, or copied
+// when neither works, instead of being downloaded again.
+class BlobStore {
+public:
+  // Uses default_root() unless given another directory
+  explicit BlobStore(const std::filesystem::path &root = {});
+
+  static std::filesystem::path default_root();
+
+  // Hash of the stored file for `url`, or `sha256` itself if that file is stored.
+  // Empty if the file has to be downloaded. An empty `url` is never found.
+  std::string find(const std::string &url, const std::string &sha256 = "");
+  // Installs the stored file `sha256` at `path`, replacing what is there
+  bool install(const std::string &sha256, const std::filesystem::path &path);
+  // Adds a copy of a freshly downloaded file to the store, found by `url` later
+  // unless it is empty
+  bool add(const std::filesystem::path &path, const std::string &sha256,
+           const std::string &url);
+
+private:
+  void load_urls();
+  void load_urls(const std::filesystem::path &path);
+  std::filesystem::path urls_path(uid_t uid) const;
+  std::filesystem::path blob_path(const std::string &sha256) const;
+
+  std::filesystem::path root;
+  std::unordered_map<std::string, std::string> urls;
+  bool loaded = false;
+};
+
+} // namespace faf
@@ -0,0 +1,446 @@
+#include "catalog.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <set>
+
+#include "../timings.h"
+#include "../util.h"
+#include "catalog_cache.h"
+#include "catalog_parser.h"
+#include "matcher.h"
+
+namespace {
+
+constexpr char CATALOG_MAGIC[4] = {'F', 'A', 'F', 'C'};
+
+// How long a catalog in a CatalogSet is reused before asking the cache again
+constexpr std::chrono::seconds WARM_RECHECK(60);
+
+// The CatalogSet::Readers alive, by the epoch they were taken in. Every catalog
+// retired starts a new epoch.
+struct reader_list {
+  std::mutex mutex;
+  uint64_t epoch = 0;
+  std::multiset<uint64_t> epochs;
+  bool taken = false;
+};
+
+reader_list &readers() {
+  static reader_list list;
+  return list;
+}
+
+std::filesystem::file_time_type source_time(const std::string &name) {
+  std::error_code ec;
+  return std::filesystem::last_write_time(faf::CatalogCache::get_path(name), ec);
+}
+
+size_t align(size_t offset) { return (offset + 7) & ~static_cast<size_t>(7); }
+
+template <typename T> void put(std::string &out, size_t offset, const T *data, size_t count) {
+  std::memcpy(out.data() + offset, data, sizeof(T) * count);
+}
+
+} // namespace
+
+namespace faf {
+
+void CatalogBuilder::add_family(std::string_view name) {
+  catalog_family family;
+  family.name = intern(name);
+  family.key = intern(Catalog::normalize(name));
+  family.axes = intern("");
+  family.version = family.axes;
+  family.last_modified = family.axes;
+  family.first_variant = static_cast<uint32_t>(variants.size());
+  family.variant_count = 0;
+  families.push_back(family);
+}
+
+void CatalogBuilder::add_variant(std::string_view key, std::string_view url) {
+  if (families.empty()) {
+    return;
+  }
+  variants.push_back({intern(key), intern(url)});
+  families.back().variant_count++;
+}
+
+void CatalogBuilder::set_axes(std::string_view axes) {
+  if (families.empty()) {
+    return;
+  }
+  families.back().axes = intern(axes);
+}
+
+void CatalogBuilder::set_version(std::string_view version, std::string_view last_modified) {
+  if (families.empty()) {
+    return;
+  }
+  families.back().version = intern(version);
+  families.back().last_modified = intern(last_modified);
+}
+
+catalog_string CatalogBuilder::intern(std::string_view s) {
+  auto [it, inserted] =
+      offsets.try_emplace(std::string(s), static_cast<uint32_t>(strings.size()));
+  if (inserted) {
+    strings.append(s);
+  }
+  return {it->second, static_cast<uint32_t>(s.size())};
+}
+
+std::string CatalogBuilder::build(uint64_t source_size, int64_t source_mtime) const {
+  std::vector<uint32_t> index(families.size());
+  std::iota(index.begin(), index.end(), 0);
+  std::stable_sort(index.begin(), index.end(), [this](uint32_t a, uint32_t b) {
+    return std::string_view(strings).substr(families[a].key.offset, families[a].key.size) <
+           std::string_view(strings).substr(families[b].key.offset, families[b].key.size);
+  });
+
+  catalog_header header{};
+  std::memcpy(header.magic, CATALOG_MAGIC, sizeof(header.magic));
+  header.version = CATALOG_VERSION;
+  header.source_size = source_size;
+  header.source_mtime = source_mtime;
+  header.family_count = static_cast<uint32_t>(families.size());
+  header.variant_count = static_cast<uint32_t>(variants.size());
+  header.strings_offset = align(sizeof(catalog_header));
+  header.strings_size = strings.size();
+  header.families_offset = align(header.strings_offset + header.strings_size);
+  header.variants_offset =
+      align(header.families_offset + families.size() * sizeof(catalog_family));
+  header.index_offset =
+      align(header.variants_offset + variants.size() * sizeof(catalog_variant));
+
+  // Substring searches scan all keys in one go, without chasing the family table
+  std::string keys;
+  std::vector<uint32_t> key_starts(index.size());
+  for (size_t i = 0; i < index.size(); i++) {
+    const catalog_string key = families[index[i]].key;
+    key_starts[i] = static_cast<uint32_t>(keys.size());
+    keys.append(strings, key.offset, key.size);
+    keys += '\n';
+  }
+
+  header.key_starts_offset = align(header.index_offset + index.size() * sizeof(uint32_t));
+  header.keys_offset = align(header.key_starts_offset + key_starts.size() * sizeof(uint32_t));
+  header.keys_size = keys.size();
+
+  std::string out(header.keys_offset + keys.size(), '\0');
+  put(out, 0, &header, 1);
+  put(out, header.strings_offset, strings.data(), strings.size());
+  put(out, header.families_offset, families.data(), families.size());
+  put(out, header.variants_offset, variants.data(), variants.size());
+  put(out, header.index_offset, index.data(), index.size());
+  put(out, header.key_starts_offset, key_starts.data(), key_starts.size());
+  put(out, header.keys_offset, keys.data(), keys.size());
+
+  return out;
+}
+
+Catalog::~Catalog() { close(); }
+
+void Catalog::close() {
+  if (mapping) {
+    munmap(mapping, mapping_size);
+    mapping = nullptr;
+    mapping_size = 0;
+  }
+  buffer.clear();
+  header = nullptr;
+}
+
+bool Catalog::open(const std::string &name, const std::string &url,
+                   const catalog_format &format, bool rebuild) {
+  close();
+
+  // A new catalog is compiled while it downloads, chunks only arrive for new ones
+  CatalogParser parser(format);
+  const auto fetch_start = timing_clock::now();
+  const bool updated =
+      CatalogCache::update(name, url, [&parser](const char *data, size_t size) {
+        parser.feed(data, size);
+      });
+  Timings::record(name + " catalog fetch", "catalog", fetch_start);
+
+  // A transfer that broke off midway leaves an unfinished document behind
+  const auto parse_start = timing_clock::now();
+  const bool streamed = parser.started() && parser.finish();
+  if (streamed) {
+    Timings::record(name + " catalog parse", "catalog", parse_start);
+  }
+
+  if (!streamed) {
+    return updated && load(name, format, rebuild);
+  }
+
+  const std::filesystem::path source_path = CatalogCache::get_path(name);
+  std::filesystem::path index_path = source_path;
+  index_path.replace_extension(".idx");
+
+  std::error_code ec;
+  const uint64_t source_size = std::filesystem::file_size(source_path, ec);
+  const int64_t source_mtime =
+      ec ? 0 : std::filesystem::last_write_time(source_path, ec).time_since_epoch().count();
+
+  std::string bytes = parser.get_builder().build(source_size, source_mtime);
+
+  if (Util::write_file(index_path, bytes) && map(index_path, source_size, source_mtime)) {
+    return true;
+  }
+
+  return adopt(std::move(bytes), source_size, source_mtime);
+}
+
+bool Catalog::load(const std::string &name, const catalog_format &format, bool rebuild) {
+  close();
+
+  const std::filesystem::path source_path = CatalogCache::get_path(name);
+  std::filesystem::path index_path = source_path;
+  index_path.replace_extension(".idx");
+
+  std::error_code ec;
+  const uint64_t source_size = std::filesystem::file_size(source_path, ec);
+  if (ec) {
+    return false;
+  }
+  const int64_t source_mtime =
+      std::filesystem::last_write_time(source_path, ec).time_since_epoch().count();
+
+  {
+    Timings::Span span(name + " catalog map", "catalog");
+    if (!rebuild && map(index_path, source_size, source_mtime)) {
+      return true;
+    }
+  }
+
+  Timings::Span span(name + " catalog parse", "catalog");
+  CatalogBuilder builder;
+  std::ifstream stream(source_path, std::ios::binary);
+  if (!stream || !CatalogParser::parse(stream, format, builder)) {
+    std::cerr << "Error: could not parse the " << name << " catalog" << std::endl;
+    return false;
+  }
+  std::string bytes = builder.build(source_size, source_mtime);
+
+  if (Util::write_file(index_path, bytes) && map(index_path, source_size, source_mtime)) {
+    return true;
+  }
+
+  return adopt(std::move(bytes), source_size, source_mtime);
+}
+
+bool Catalog::adopt(std::string bytes, uint64_t source_size, int64_t source_mtime) {
+  close();
+  buffer = std::move(bytes);
+  return attach(buffer.data(), buffer.size(), source_size, source_mtime);
+}
+
+bool Catalog::map(const std::filesystem::path &path, uint64_t source_size,
+                  int64_t source_mtime) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  mapping = data;
+  mapping_size = st.st_size;
+  if (attach(static_cast<const char *>(data), mapping_size, source_size, source_mtime)) {
+    return true;
+  }
+  close();
+  return false;
+}
+
+bool Catalog::attach(const char *data, size_t size, uint64_t source_size,
+                     int64_t source_mtime) {
+  if (size < sizeof(catalog_header)) {
+    return false;
+  }
+
+  const catalog_header *h = reinterpret_cast<const catalog_header *>(data);
+
+  if (std::memcmp(h->magic, CATALOG_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != CATALOG_VERSION || h->source_size != source_size ||
+      h->source_mtime != source_mtime) {
+    return false;
+  }
+
+  if (h->strings_offset + h->strings_size > size ||
+      h->families_offset + uint64_t(h->family_count) * sizeof(catalog_family) > size ||
+      h->variants_offset + uint64_t(h->variant_count) * sizeof(catalog_variant) > size ||
+      h->index_offset + uint64_t(h->family_count) * sizeof(uint32_t) > size ||
+      h->key_starts_offset + uint64_t(h->family_count) * sizeof(uint32_t) > size ||
+      h->keys_offset + h->keys_size > size) {
+    return false;
+  }
+
+  header = h;
+  strings = data + h->strings_offset;
+  families = reinterpret_cast<const catalog_family *>(data + h->families_offset);
+  variant_table = reinterpret_cast<const catalog_variant *>(data + h->variants_offset);
+  name_index = reinterpret_cast<const uint32_t *>(data + h->index_offset);
+  key_starts = reinterpret_cast<const uint32_t *>(data + h->key_starts_offset);
+  keys = std::string_view(data + h->keys_offset, h->keys_size);
+
+  return true;
+}
+
+uint32_t Catalog::size() const { return header ? header->family_count : 0; }
+
+const catalog_family &Catalog::family(uint32_t id) const { return families[id]; }
+
+std::span<const catalog_variant> Catalog::variants(const catalog_family &family) const {
+  return {variant_table + family.first_variant, family.variant_count};
+}
+
+std::span<const uint32_t> Catalog::index() const { return {name_index, size()}; }
+
+std::span<const uint32_t> Catalog::find_prefix(std::string_view prefix) const {
+  const auto ids = index();
+
+  auto first = std::lower_bound(ids.begin(), ids.end(), prefix,
+                                [this](uint32_t id, std::string_view p) {
+                                  return str(families[id].key) < p;
+                                });
+  // Keys starting with the prefix sort right after it, so they form one run
+  auto last = std::upper_bound(first, ids.end(), prefix,
+                               [this](std::string_view p, uint32_t id) {
+                                 return p < str(families[id].key).substr(0, p.size());
+                               });
+
+  return {first, last};
+}
+
+std::vector<uint32_t> Catalog::find_substring(std::string_view part) const {
+  std::vector<uint32_t> ids;
+  if (size() == 0) {
+    return ids;
+  }
+  const uint32_t *starts_end = key_starts + size();
+
+  size_t pos = 0;
+  while ((pos = Matcher::find(keys, part, pos)) != std::string_view::npos) {
+    // The key the match is in, then on to the next one
+    const uint32_t *next = std::upper_bound(key_starts, starts_end, pos);
+    const size_t slot = next - key_starts - 1;
+    ids.push_back(name_index[slot]);
+
+    if (next == starts_end) {
+      break;
+    }
+    pos = *next;
+  }
+
+  return ids;
+}
+
+CatalogSet::Reader::Reader() {
+  reader_list &list = readers();
+  std::lock_guard<std::mutex> guard(list.mutex);
+  list.taken = true;
+  epoch = list.epoch;
+  list.epochs.insert(epoch);
+}
+
+CatalogSet::Reader::~Reader() {
+  reader_list &list = readers();
+  std::lock_guard<std::mutex> guard(list.mutex);
+  list.epochs.erase(list.epochs.find(epoch));
+}
+
+Catalog *CatalogSet::find(const std::string &name, const std::string &url) {
+  auto it = warm.find(name);
+  if (it == warm.end()) {
+    return nullptr;
+  }
+
+  // Another process, or another courier of this one, may have refreshed the cache
+  const auto now = std::chrono::steady_clock::now();
+  if (now - it->second.checked >= WARM_RECHECK) {
+    if (!CatalogCache::is_fresh(name, url) || source_time(name) != it->second.source) {
+      return nullptr;
+    }
+    it->second.checked = now;
+  }
+  return it->second.catalog;
+}
+
+Catalog &CatalogSet::open(const std::string &name, const std::string &url,
+                          const catalog_format &format) {
+  if (Catalog *catalog = find(name, url)) {
+    return *catalog;
+  }
+
+  Catalog &catalog = add();
+  if (catalog.open(name, url, format)) {
+    warm[name] = {&catalog, std::chrono::steady_clock::now(), source_time(name)};
+    trim();
+  }
+  return catalog;
+}
+
+Catalog &CatalogSet::add() {
+  catalogs.push_back(std::make_unique<Catalog>());
+  trim();
+  return *catalogs.back();
+}
+
+void CatalogSet::trim() {
+  reader_list &list = readers();
+  std::lock_guard<std::mutex> guard(list.mutex);
+
+  for (size_t i = 0; i + 1 < catalogs.size();) {
+    const bool is_warm = std::any_of(warm.begin(), warm.end(), [&](const auto &entry) {
+      return entry.second.catalog == catalogs[i].get();
+    });
+    if (is_warm) {
+      i++;
+      continue;
+    }
+    retired.push_back({std::move(catalogs[i]), ++list.epoch});
+    catalogs.erase(catalogs.begin() + i);
+  }
+
+  if (!list.taken) {
+    return;
+  }
+  std::erase_if(retired, [&list](const retired_catalog &r) {
+    return list.epochs.empty() || *list.epochs.begin() >= r.epoch;
+  });
+}
+
+std::string_view Catalog::str(catalog_string s) const { return {strings + s.offset, s.size}; }
+
+std::string Catalog::normalize(std::string_view name) {
+  std::string key(name);
+  for (auto &c : key) {
+    c = c == '-' ? ' ' : std::tolower(static_cast<unsigned char>(c));
+  }
+  return key;
+}
+
+} // namespace faf
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace faf {
+
+// Compiled form of a courier's catalog, stored as `<name>.idx` next to the cached
+// JSON it was built from:
+//
+//   catalog_header
+//   string table     every string, deduplicated, not terminated
+//   family table     catalog_family[family_count]
+//   variant table    catalog_variant[variant_count], grouped by family
+//   name index       uint32_t[family_count], family ids sorted by their key
+//   key starts       uint32_t[family_count], where each key of the index is in
+//   packed keys      the keys in index order, each followed by '\n'
+//
+// The file is mapped read-only, so a search only touches the pages it reads. It is
+// rebuilt whenever the version or the fingerprint of the JSON source don't match.
+constexpr uint32_t CATALOG_VERSION = 5;
+
+struct catalog_string {
+  uint32_t offset;
+  uint32_t size;
+};
+
+struct catalog_header {
+  char magic[4];
+  uint32_t version;
+  uint64_t source_size;
+  int64_t source_mtime;
+  uint32_t family_count;
+  uint32_t variant_count;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+  uint64_t families_offset;
+  uint64_t variants_offset;
+  uint64_t index_offset;
+  uint64_t key_starts_offset;
+  uint64_t keys_offset;
+  uint64_t keys_size;
+};
+
+struct catalog_family {
+  catalog_string name;
+  catalog_string key; // lowercase, with '-' folded to ' '
+  catalog_string axes; // "tag:start-end" of a variable font, comma separated
+  catalog_string version;
+  catalog_string last_modified;
+  uint32_t first_variant;
+  uint32_t variant_count;
+};
+
+struct catalog_variant {
+  catalog_string key;
+  catalog_string url; // or the part of it the courier doesn't know up front
+};
+
+class CatalogBuilder {
+public:
+  void add_family(std::string_view name);
+  // Adds a variant to the family added last
+  void add_variant(std::string_view key, std::string_view url);
+  // Sets the variable font axes of the family added last
+  void set_axes(std::string_view axes);
+  // Sets the release of the family added last, as far as the catalog tells
+  void set_version(std::string_view version, std::string_view last_modified);
+
+  std::string build(uint64_t source_size, int64_t source_mtime) const;
+
+private:
+  catalog_string intern(std::string_view s);
+
+  std::string strings;
+  std::unordered_map<std::string, uint32_t> offsets;
+  std::vector<catalog_family> families;
+  std::vector<catalog_variant> variants;
+};
+
+// One entry of a catalog's JSON, holding only the members the courier asked for.
+// String and number members end up in `fields`, the string members of object
+// members (like Google's "files") in `objects`. Array members of objects are
+// flattened into `objects` too, element after element.
+struct catalog_record {
+  std::unordered_map<std::string, std::string> fields;
+  std::unordered_map<std::string, std::vector<std::pair<std::string, std::string>>>
+      objects;
+};
+
+// Describes where the entries of a courier's catalog are and how to compile them
+struct catalog_format {
+  // Key of the array holding the entries in the top-level object, empty if the
+  // catalog is a top-level array
+  std::string records;
+  // Members of an entry to keep, everything else is skipped while parsing
+  std::vector<std::string> fields;
+  std::function<void(const catalog_record &, CatalogBuilder &)> add;
+};
+
+class Catalog {
+public:
+  Catalog() = default;
+  ~Catalog();
+
+  Catalog(const Catalog &) = delete;
+  Catalog &operator=(const Catalog &) = delete;
+
+  // Brings the cached catalog `name` up to date from `url` and opens its compiled
+  // form. A freshly downloaded catalog is parsed while it arrives, a cached one is
+  // compiled if its index is missing, stale or `rebuild` is set.
+  bool open(const std::string &name, const std::string &url, const catalog_format &format,
+            bool rebuild = false);
+  // Opens the cached catalog `name` as it is, without contacting the server
+  bool load(const std::string &name, const catalog_format &format, bool rebuild = false);
+  // Takes over a catalog built in memory by CatalogBuilder::build()
+  bool adopt(std::string bytes, uint64_t source_size = 0, int64_t source_mtime = 0);
+
+  uint32_t size() const;
+
+  const catalog_family &family(uint32_t id) const;
+  std::span<const catalog_variant> variants(const catalog_family &family) const;
+  // Family ids sorted by key
+  std::span<const uint32_t> index() const;
+  // Ids of the families whose key starts with `prefix`, which must be normalized
+  std::span<const uint32_t> find_prefix(std::string_view prefix) const;
+  // Ids of the families whose key contains `part`, which must be normalized, in
+  // the order of the index
+  std::vector<uint32_t> find_substring(std::string_view part) const;
+
+  std::string_view str(catalog_string s) const;
+
+  static std::string normalize(std::string_view name);
+
+private:
+  bool attach(const char *data, size_t size, uint64_t source_size,
+              int64_t source_mtime);
+  bool map(const std::filesystem::path &path, uint64_t source_size, int64_t source_mtime);
+  void close();
+
+  void *mapping = nullptr;
+  size_t mapping_size = 0;
+  // Used instead of a mapping when the index can't be written to disk
+  std::string buffer;
+
+  const catalog_header *header = nullptr;
+  const char *strings = nullptr;
+  const catalog_family *families = nullptr;
+  const catalog_variant *variant_table = nullptr;
+  const uint32_t *name_index = nullptr;
+  const uint32_t *key_starts = nullptr;
+  std::string_view keys;
+};
+
+// The catalogs a courier opened. The catalog opened last under a name is reused
+// while the cache considers it fresh and unchanged, which is only asked again
+// after a while, so in a long-running process a search doesn't even touch the
+// disk.
+//
+// Results point into the catalogs they were found in. A catalog the set is done
+// with, one replaced under its name or one from add() that another add() came
+// after, is therefore only freed once no Reader taken before that is left. As
+// long as a process never takes a Reader, every catalog stays open for as long
+// as its set.
+class CatalogSet {
+public:
+  // Held for as long as the results of the searches made meanwhile are used
+  class Reader {
+  public:
+    Reader();
+    ~Reader();
+
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+
+  private:
+    uint64_t epoch;
+  };
+
+  // The catalog `name` opened last, if it is still fresh
+  Catalog *find(const std::string &name, const std::string &url);
+  // find(), or opens the catalog like Catalog::open() if there's none
+  Catalog &open(const std::string &name, const std::string &url,
+                const catalog_format &format);
+  // An empty catalog to fill otherwise, which is never reused
+  Catalog &add();
+
+private:
+  struct warm_catalog {
+    Catalog *catalog;
+    std::chrono::steady_clock::time_point checked;
+    // Modification time of the cached JSON the catalog was opened from
+    std::filesystem::file_time_type source;
+  };
+
+  struct retired_catalog {
+    std::unique_ptr<Catalog> catalog;
+    uint64_t epoch;
+  };
+
+  // Retires every catalog but the warm ones and the one added last, and frees
+  // the retired ones no Reader can have seen
+  void trim();
+
+  std::vector<std::unique_ptr<Catalog>> catalogs;
+  std::vector<retired_catalog> retired;
+  std::unordered_map<std::string, warm_catalog> warm;
+};
+
+} // namespace faf
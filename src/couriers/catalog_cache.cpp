@@ -0,0 +1,250 @@
+#include "catalog_cache.h"
+
+#include <curl/curl.h>
+
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <string>
+
+#include "../external/nlohmann/json.hpp"
+#include "../timings.h"
+#include "../util.h"
+#include "rate_limit.h"
+#include "transfer.h"
+
+namespace {
+using json = nlohmann::json;
+
+// The url without its API key, which has no business in a file under the cache dir
+std::string redact_key(const std::string &url) {
+  const size_t query = url.find('?');
+  if (query == std::string::npos) {
+    return url;
+  }
+
+  std::string redacted = url.substr(0, query);
+  char separator = '?';
+  size_t start = query + 1;
+  while (start <= url.size()) {
+    size_t end = url.find('&', start);
+    if (end == std::string::npos) {
+      end = url.size();
+    }
+    if (end > start && url.compare(start, 4, "key=") != 0) {
+      redacted += separator;
+      redacted.append(url, start, end - start);
+      separator = '&';
+    }
+    start = end + 1;
+  }
+  return redacted;
+}
+
+// Reads the validators of a cached catalog, true if the catalog was fetched from `url`
+bool read_meta(const std::filesystem::path &meta_path, const std::filesystem::path &body_path,
+               const std::string &url, json &meta) {
+  std::string raw;
+  if (faf::Util::read_file(meta_path, raw)) {
+    meta = json::parse(raw, nullptr, false);
+  }
+  // The url includes any other query parameters, so a changed request is a cache miss
+  return meta.is_object() && meta.value("url", "") == redact_key(url) &&
+         std::filesystem::exists(body_path);
+}
+
+struct body {
+  CURL *handle;
+  std::filesystem::path path;
+  FILE *fp;
+  const faf::catalog_sink *sink;
+};
+
+// Writes a successful response to disk as it arrives and passes it on to the sink
+size_t body_callback(char *data, size_t size, size_t nmemb, void *userdata) {
+  body *b = static_cast<body *>(userdata);
+  size_t length = size * nmemb;
+  faf::RateLimit::get().consume(length);
+
+  // Protocols without status codes (file://) report 0 on success
+  long status = 0;
+  curl_easy_getinfo(b->handle, CURLINFO_RESPONSE_CODE, &status);
+  if (status != 200 && status != 0) {
+    return length;
+  }
+
+  if (!b->fp) {
+    b->fp = fopen(b->path.c_str(), "wb");
+    if (!b->fp) {
+      return 0;
+    }
+  }
+
+  if (fwrite(data, 1, length, b->fp) != length) {
+    return 0;
+  }
+
+  if (*b->sink) {
+    (*b->sink)(data, length);
+  }
+
+  return length;
+}
+
+} // namespace
+
+namespace faf {
+
+long CatalogCache::ttl = 24 * 60 * 60;
+CACHE_POLICY CatalogCache::policy = CACHE_POLICY::DEFAULT;
+
+void CatalogCache::configure(long ttl_seconds, CACHE_POLICY policy) {
+  CatalogCache::ttl = ttl_seconds;
+  CatalogCache::policy = policy;
+}
+
+std::filesystem::path CatalogCache::get_path(const std::string &name) {
+  return Util::get_cache_dir() / (name + ".json");
+}
+
+bool CatalogCache::is_fresh(const std::string &name, const std::string &url) {
+  json meta;
+  bool have_cached =
+      read_meta(Util::get_cache_dir() / (name + ".meta"), get_path(name), url, meta);
+
+  if (policy == CACHE_POLICY::OFFLINE) {
+    return have_cached;
+  }
+
+  const long now = static_cast<long>(std::time(nullptr));
+  return have_cached && policy == CACHE_POLICY::DEFAULT &&
+         now - meta.value("checked", 0L) < ttl;
+}
+
+bool CatalogCache::is_offline() { return policy == CACHE_POLICY::OFFLINE; }
+
+bool CatalogCache::update(const std::string &name, const std::string &url,
+                          const catalog_sink &sink) {
+  const std::filesystem::path cache_dir = Util::get_cache_dir();
+  const std::filesystem::path body_path = get_path(name);
+  const std::filesystem::path meta_path = cache_dir / (name + ".meta");
+
+  json meta;
+  bool have_cached = read_meta(meta_path, body_path, url, meta);
+
+  if (policy == CACHE_POLICY::OFFLINE) {
+    if (!have_cached) {
+      std::cerr << "Error: no cached " << name << " catalog available offline, "
+                << "run faf once without --offline to fetch it" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  const long now = static_cast<long>(std::time(nullptr));
+
+  if (have_cached && policy == CACHE_POLICY::DEFAULT &&
+      now - meta.value("checked", 0L) < ttl) {
+    return true;
+  }
+
+  CURL *curl_handle = Transfer::get().acquire();
+  if (!curl_handle) {
+    std::cerr << "Error: could not initialize curl" << std::endl;
+    return have_cached;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(cache_dir, ec);
+
+  http_validators received;
+  // Two faf at once, or two attempts of one, each download a copy of their own
+  const std::filesystem::path download_path = Util::temp_path(body_path, ".download");
+  body res{curl_handle, download_path, nullptr, &sink};
+  struct curl_slist *headers = nullptr;
+
+  if (have_cached) {
+    if (!meta.value("etag", "").empty()) {
+      headers = curl_slist_append(
+          headers, ("If-None-Match: " + meta.value("etag", "")).c_str());
+    }
+    if (!meta.value("last_modified", "").empty()) {
+      headers = curl_slist_append(
+          headers, ("If-Modified-Since: " + meta.value("last_modified", "")).c_str());
+    }
+  }
+
+  curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
+  curl_easy_setopt(curl_handle, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, Transfer::read_validators);
+  curl_easy_setopt(curl_handle, CURLOPT_HEADERDATA, static_cast<void *>(&received));
+  curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, body_callback);
+  curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, static_cast<void *>(&res));
+
+  CURLcode ret = curl_easy_perform(curl_handle);
+  Timings::record_transfer(name + " catalog", curl_handle);
+
+  long status = 0;
+  curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &status);
+
+  Transfer::get().release(curl_handle);
+  curl_slist_free_all(headers);
+
+  bool written = res.fp && fclose(res.fp) == 0;
+  if (!res.fp && ret == CURLE_OK && (status == 200 || status == 0)) {
+    // An empty body never opened the file
+    written = Util::write_file(download_path, "");
+  }
+
+  if (ret == CURLE_OK && status == 304 && have_cached) {
+    meta["checked"] = now;
+    Util::write_file(meta_path, meta.dump(2));
+    return true;
+  }
+
+  if (ret == CURLE_OK && (status == 200 || status == 0)) {
+    json new_meta = {{"url", redact_key(url)},
+                     {"etag", received.etag},
+                     {"last_modified", received.last_modified},
+                     {"checked", now}};
+
+    // Drop the old validators first, so a meta file always describes the body
+    // next to it even if one of the steps fails
+    std::filesystem::remove(meta_path, ec);
+    if (written) {
+      std::filesystem::rename(download_path, body_path, ec);
+    }
+    if (!written || ec || !Util::write_file(meta_path, new_meta.dump(2))) {
+      std::cerr << "Error: could not write the " << name << " catalog to "
+                << cache_dir.string() << std::endl;
+      std::filesystem::remove(download_path, ec);
+      return false;
+    }
+    return true;
+  }
+
+  std::filesystem::remove(download_path, ec);
+
+  // Given up on by whoever asked, see Transfer::CancelScope
+  if (ret == CURLE_ABORTED_BY_CALLBACK) {
+    return have_cached;
+  }
+
+  if (ret != CURLE_OK) {
+    std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(ret) << std::endl;
+  } else {
+    std::cerr << "Error: " << name << " catalog request returned HTTP " << status
+              << std::endl;
+  }
+
+  if (have_cached) {
+    std::cerr << "Warning: using the cached " << name << " catalog" << std::endl;
+    return true;
+  }
+
+  return false;
+}
+
+} // namespace faf
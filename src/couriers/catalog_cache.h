@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+namespace faf {
+
+enum class CACHE_POLICY {
+  DEFAULT, // Use the cached catalog until it is older than the TTL, then revalidate
+  REFRESH, // Always revalidate with the server
+  OFFLINE  // Never touch the network, fail if nothing is cached
+};
+
+// Receives the body of a freshly downloaded catalog while it arrives
+using catalog_sink = std::function<void(const char *, size_t)>;
+
+// On-disk cache for the catalogs the couriers search in, kept under ~/.cache/faf/.
+//
+// Each catalog is stored as `<name>.json` next to a `<name>.meta` file holding the
+// ETag and Last-Modified validators the server sent. Once the TTL has expired the
+// catalog is revalidated with a conditional request, so an unchanged catalog costs
+// a single round trip answered with 304 Not Modified.
+class CatalogCache {
+public:
+  static void configure(long ttl_seconds, CACHE_POLICY policy);
+
+  // Location of the cached catalog `name`, valid after a successful update()
+  static std::filesystem::path get_path(const std::string &name);
+
+  // Whether update() would use the cached catalog without contacting the server
+  static bool is_fresh(const std::string &name, const std::string &url);
+  // Whether the network must be left alone
+  static bool is_offline();
+
+  // Makes sure the catalog `name` is cached, fetching or revalidating it from `url`
+  // when needed. Falls back to a stale copy if the server can't be reached.
+  // A new catalog is streamed to disk and, chunk by chunk, to `sink`.
+  static bool update(const std::string &name, const std::string &url,
+                     const catalog_sink &sink = nullptr);
+
+private:
+  static long ttl;
+  static CACHE_POLICY policy;
+};
+
+} // namespace faf
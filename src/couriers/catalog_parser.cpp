@@ -0,0 +1,231 @@
+#include "catalog_parser.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "../external/nlohmann/json.hpp"
+
+namespace {
+using json = nlohmann::json;
+
+// Bounds the text waiting for the parser when the network outpaces it
+constexpr size_t MAX_QUEUED = 4 * 1024 * 1024;
+
+// Collects the kept members of every entry and hands each entry to the courier as
+// soon as its closing brace is read.
+class record_handler : public nlohmann::json_sax<json> {
+public:
+  record_handler(const faf::catalog_format &format, faf::CatalogBuilder &builder)
+      : format(format), builder(builder) {}
+
+  bool null() override { return true; }
+  bool boolean(bool val) override { return value(val ? "true" : "false"); }
+  bool number_integer(number_integer_t val) override { return value(std::to_string(val)); }
+  bool number_unsigned(number_unsigned_t val) override {
+    return value(std::to_string(val));
+  }
+  bool number_float(number_float_t, const string_t &s) override { return value(s); }
+  bool string(string_t &val) override { return value(val); }
+  bool binary(binary_t &) override { return true; }
+
+  bool key(string_t &val) override {
+    current_key = val;
+    return true;
+  }
+
+  bool start_object(std::size_t) override {
+    if (!in_record && is_records()) {
+      in_record = true;
+      record_depth = stack.size() + 1;
+      record = {};
+    } else if (in_record && stack.size() == record_depth && is_kept(current_key)) {
+      object = current_key;
+      object_depth = record_depth + 1;
+    }
+
+    push(false);
+    return true;
+  }
+
+  bool end_object() override {
+    if (in_record && stack.size() == record_depth) {
+      format.add(record, builder);
+      in_record = false;
+    } else if (in_record && stack.size() == record_depth + 1) {
+      object.clear();
+    }
+
+    stack.pop_back();
+    return true;
+  }
+
+  bool start_array(std::size_t) override {
+    // The objects of an array member (like Google's "axes") are read one after
+    // the other into the same list
+    if (in_record && stack.size() == record_depth && is_kept(current_key)) {
+      object = current_key;
+      object_depth = record_depth + 2;
+    }
+
+    push(true);
+    return true;
+  }
+
+  bool end_array() override {
+    if (in_record && stack.size() == record_depth + 1) {
+      object.clear();
+    }
+
+    stack.pop_back();
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string &,
+                   const nlohmann::detail::exception &) override {
+    return false;
+  }
+
+private:
+  struct frame {
+    bool is_array;
+    std::string key;
+  };
+
+  // Whether an object starting now is one of the catalog's entries
+  bool is_records() const {
+    if (stack.empty() || !stack.back().is_array) {
+      return false;
+    }
+    if (format.records.empty()) {
+      return stack.size() == 1;
+    }
+    return stack.size() == 2 && !stack[0].is_array && stack[1].key == format.records;
+  }
+
+  bool is_kept(const std::string &key) const {
+    return std::find(format.fields.begin(), format.fields.end(), key) !=
+           format.fields.end();
+  }
+
+  void push(bool is_array) {
+    bool in_object = !stack.empty() && !stack.back().is_array;
+    stack.push_back({is_array, in_object ? current_key : std::string()});
+  }
+
+  bool value(const std::string &val) {
+    if (!in_record || stack.back().is_array) {
+      return true;
+    }
+
+    if (stack.size() == record_depth && is_kept(current_key)) {
+      record.fields[current_key] = val;
+    } else if (stack.size() == object_depth && !object.empty()) {
+      record.objects[object].emplace_back(current_key, val);
+    }
+
+    return true;
+  }
+
+  const faf::catalog_format &format;
+  faf::CatalogBuilder &builder;
+
+  std::vector<frame> stack;
+  std::string current_key;
+
+  bool in_record = false;
+  size_t record_depth = 0;
+  faf::catalog_record record;
+  // Kept object or array member of the current entry being read, empty if none
+  std::string object;
+  size_t object_depth = 0;
+};
+
+} // namespace
+
+namespace faf {
+
+CatalogParser::CatalogParser(const catalog_format &format) : format(format) {}
+
+CatalogParser::~CatalogParser() { finish(); }
+
+void CatalogParser::feed(const char *data, size_t size) {
+  if (size == 0) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+
+  if (!launched) {
+    launched = true;
+    worker = std::thread([this]() {
+      std::istream stream(this);
+      bool parsed = parse(stream, format, builder);
+
+      std::lock_guard<std::mutex> guard(mutex);
+      ok = parsed;
+      done = true;
+      cv.notify_all();
+    });
+  }
+
+  cv.wait(lock, [this]() { return queued < MAX_QUEUED || done; });
+  // The parser gave up on a broken document, there's no point queueing the rest
+  if (done) {
+    return;
+  }
+
+  chunks.emplace_back(data, size);
+  queued += size;
+  cv.notify_all();
+}
+
+bool CatalogParser::finish() {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    closed = true;
+    cv.notify_all();
+  }
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+
+  std::lock_guard<std::mutex> guard(mutex);
+  return ok;
+}
+
+bool CatalogParser::started() const {
+  std::lock_guard<std::mutex> guard(mutex);
+  return launched;
+}
+
+CatalogBuilder &CatalogParser::get_builder() { return builder; }
+
+bool CatalogParser::parse(std::istream &stream, const catalog_format &format,
+                          CatalogBuilder &builder) {
+  record_handler handler(format, builder);
+  try {
+    return json::sax_parse(stream, &handler);
+  } catch (const json::exception &e) {
+    return false;
+  }
+}
+
+CatalogParser::int_type CatalogParser::underflow() {
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait(lock, [this]() { return !chunks.empty() || closed; });
+
+  if (chunks.empty()) {
+    return traits_type::eof();
+  }
+
+  current = std::move(chunks.front());
+  chunks.pop_front();
+  queued -= current.size();
+  cv.notify_all();
+
+  setg(current.data(), current.data(), current.data() + current.size());
+  return traits_type::to_int_type(current[0]);
+}
+
+} // namespace faf
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#include "catalog.h"
+
+namespace faf {
+
+// Compiles a catalog's JSON into a CatalogBuilder with a SAX parser, without ever
+// holding the whole text or a DOM of it in memory.
+//
+// Chunks handed to feed() are parsed on a worker thread while the caller keeps
+// receiving the rest, so parsing overlaps with the transfer.
+class CatalogParser : private std::streambuf {
+public:
+  explicit CatalogParser(const catalog_format &format);
+  ~CatalogParser();
+
+  CatalogParser(const CatalogParser &) = delete;
+  CatalogParser &operator=(const CatalogParser &) = delete;
+
+  // Queues a chunk of the catalog, blocking while too much is already queued
+  void feed(const char *data, size_t size);
+  // Marks the end of the catalog and waits for the parser, true if it succeeded
+  bool finish();
+
+  bool started() const;
+  CatalogBuilder &get_builder();
+
+  // Parses a complete catalog on the calling thread
+  static bool parse(std::istream &stream, const catalog_format &format,
+                    CatalogBuilder &builder);
+
+private:
+  int_type underflow() override;
+
+  const catalog_format &format;
+  CatalogBuilder builder;
+
+  std::thread worker;
+  bool launched = false;
+  bool ok = false;
+
+  mutable std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::string> chunks;
+  size_t queued = 0;
+  bool closed = false;
+  bool done = false;
+
+  // Chunk currently being read by the parser
+  std::string current;
+};
+
+} // namespace faf
@@ -1,21 +1,46 @@
 #pragma once
 
 #include <cstdint>
+#include <filesystem>
 #include <string>
+#include <string_view>
 
 namespace faf {
 
+// Names of the weights 100 to 900, as --attend takes them
+inline constexpr std::string_view WEIGHT_NAMES[] = {
+    "thin", "extralight", "light", "regular", "medium",
+    "semibold", "bold", "extrabold", "black"};
+
+// A single font file found in a catalog. The strings are views into the catalog
+// and string arena of the courier that found it, so records are cheap to copy
+// and stay valid as long as that courier.
 struct font_props {
-  std::string name;
-  std::string prop;
-  std::string file_format;
-  std::string url;
-  std::string weight;
+  std::string_view name;
+  std::string_view prop;
+  std::string_view file_format;
+  std::string_view url;
+  std::string_view weight;
+  std::string_view source;
+  // Weight axis range of a variable font, both 0 for static fonts
+  int min_weight = 0;
+  int max_weight = 0;
+  // Release of the family in the catalog, empty if the source doesn't say
+  std::string_view version;
+  std::string_view last_modified;
+  // Expected hash of the file, set when installing from a lockfile
+  std::string_view sha256;
+  // Whether the file behind the URL never changes, like Google's versioned files
+  bool immutable = false;
 };
 
 class Common {
 public:
-  static bool download_font(font_props font, bool system_wide);
+  // Numeric value of a weight name like "semibold", 0 if unknown
+  static int weight_value(std::string_view weight);
+
+  static std::filesystem::path get_install_dir(std::string font_name, bool system_wide);
+  static bool download_font(const font_props &font, bool system_wide);
 
   static std::uintmax_t remove_font_family(std::string font_name, bool system_wide);
   static bool remove_single_font(std::string font_name, std::string font_type,
@@ -0,0 +1,30 @@
+#include "courier.h"
+
+namespace faf {
+
+void Courier::configure(const search_options &options) { this->options = options; }
+
+void Courier::set_exact(bool exact) { options.exact = exact; }
+
+void Courier::set_contains(bool contains) { options.contains = contains; }
+
+void Courier::set_variable(bool variable) { options.variable = variable; }
+
+std::vector<uint32_t> Courier::match(const Catalog &catalog,
+                                     std::string_view query) const {
+  const std::string key = Catalog::normalize(query);
+
+  if (options.contains && !options.exact) {
+    return catalog.find_substring(key);
+  }
+
+  std::vector<uint32_t> ids;
+  for (uint32_t id : catalog.find_prefix(key)) {
+    if (!options.exact || catalog.str(catalog.family(id).key) == key) {
+      ids.push_back(id);
+    }
+  }
+  return ids;
+}
+
+} // namespace faf
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catalog.h"
+#include "common.h"
+#include "mirror.h"
+
+namespace faf {
+
+// How a search should match
+struct search_options {
+  // Only match whole family names
+  bool exact = false;
+  // Match families containing a query anywhere in their name, not just at the start
+  bool contains = false;
+  // Prefer the variable font files of a family to its static weights
+  bool variable = false;
+};
+
+// A source of fonts. The Registry runs the searches of all of them at once, so
+// a new source only has to know how to search its own catalog.
+//
+// Whatever a search returns has to be downloadable by the Downloader, which is
+// anything curl can fetch, file:// URLs included.
+class Courier {
+public:
+  virtual ~Courier() = default;
+
+  // Finds the families matching each query, the results are in query order.
+  // They point into this courier, which keeps every catalog it searched open.
+  virtual std::vector<std::vector<font_props>>
+  search(std::span<const std::string> query) = 0;
+
+  // Opens the catalog now, so the searches after it find it open
+  virtual bool preload() { return true; }
+
+  // Recompiles the binary index of the catalog
+  virtual bool rebuild_index() { return true; }
+
+  // Copies the catalog to the mirror in `dir` and lists the files of the families
+  // matching `filter`, or of all of them if it is empty. Sources without a place
+  // in the mirror's layout leave it alone.
+  virtual bool mirror_to([[maybe_unused]] const std::filesystem::path &dir,
+                         [[maybe_unused]] std::span<const std::string> filter,
+                         [[maybe_unused]] std::vector<mirror_file> &files) {
+    return true;
+  }
+
+  void configure(const search_options &options);
+  void set_exact(bool exact);
+  void set_contains(bool contains);
+  void set_variable(bool variable);
+
+protected:
+  // Ids of the families in `catalog` matching `query` the way the options ask
+  std::vector<uint32_t> match(const Catalog &catalog, std::string_view query) const;
+
+  search_options options;
+};
+
+} // namespace faf
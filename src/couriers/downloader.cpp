@@ -0,0 +1,450 @@
+#include "downloader.h"
+
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../progress.h"
+#include "../sha256.h"
+#include "../timings.h"
+#include "../util.h"
+#include "blob_store.h"
+#include "manifest.h"
+#include "subsetter.h"
+#include "transfer.h"
+#include "transfer_loop.h"
+#include "zip_extractor.h"
+
+namespace {
+
+// Later attempts resume from what the earlier ones received
+struct transfer : faf::TransferLoop::item {
+  size_t index;
+  faf::progress_item *progress;
+  FILE *fp;
+  std::filesystem::path path;
+  // Received so far, written to `path` only once complete
+  std::filesystem::path part;
+  // Where `part` came from, see write_part_meta()
+  std::filesystem::path part_meta;
+  std::string url;
+  // ETag, or else Last-Modified, of the response the part file holds
+  std::string validator;
+  // Of the current attempt's response
+  faf::http_validators received;
+  struct curl_slist *headers;
+  // Bytes already in `part` when the current attempt started
+  curl_off_t offset;
+  bool started;
+  // Set when the response turned out to be a ZIP archive
+  std::unique_ptr<faf::ZipExtractor> zip;
+  std::unique_ptr<faf::Sha256> archive_hash;
+  char error[CURL_ERROR_SIZE];
+};
+
+// The URL and the validator of the response a part file holds, one per line. A
+// part file is only resumed from the same URL with If-Range, so a file that
+// changed in between is sent whole instead of appended to the old bytes.
+bool write_part_meta(const transfer *t) {
+  return faf::Util::write_file(t->part_meta, t->url + "\n" + t->validator + "\n");
+}
+
+// The validator to resume the part file with, or empty to start over
+std::string read_part_meta(const std::filesystem::path &path, const std::string &url) {
+  std::string raw;
+  if (!faf::Util::read_file(path, raw)) {
+    return "";
+  }
+  const size_t newline = raw.find('\n');
+  if (newline == std::string::npos || raw.compare(0, newline, url) != 0) {
+    return "";
+  }
+  std::string validator = raw.substr(newline + 1);
+  validator.erase(validator.find_last_not_of("\r\n") + 1);
+  return validator;
+}
+
+size_t transfer_write_callback(char *data, size_t size, size_t nmemb, void *userdata) {
+  transfer *t = static_cast<transfer *>(userdata);
+
+  if (!t->loop->take(t, size * nmemb)) {
+    return CURL_WRITEFUNC_PAUSE;
+  }
+
+  if (!t->started) {
+    t->started = true;
+
+    curl_off_t length = -1;
+    curl_easy_getinfo(t->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    if (length > 0) {
+      t->progress->total.store(t->offset + length, std::memory_order_relaxed);
+    }
+
+    // Packages like FontSquirrel's are unpacked as they arrive instead of stored
+    if (t->offset == 0 && faf::ZipExtractor::is_zip(data, size * nmemb)) {
+      t->zip = std::make_unique<faf::ZipExtractor>(t->path.parent_path());
+      t->archive_hash = std::make_unique<faf::Sha256>();
+    } else {
+      // Weak ETags don't count for ranges, Last-Modified does
+      if (t->offset == 0) {
+        const faf::http_validators &received = t->received;
+        t->validator = received.etag.starts_with("W/") ? "" : received.etag;
+        if (t->validator.empty()) {
+          t->validator = received.last_modified;
+        }
+        write_part_meta(t);
+      }
+#if defined(__linux__)
+      // Reserving the space up front keeps the file from fragmenting, KEEP_SIZE
+      // leaves its size alone so an interrupted transfer still resumes correctly
+      if (length > 0) {
+        fallocate(fileno(t->fp), FALLOC_FL_KEEP_SIZE, t->offset, length);
+      }
+#endif // __linux__
+    }
+  }
+
+  t->progress->received.fetch_add(size * nmemb, std::memory_order_relaxed);
+
+  if (t->zip) {
+    t->archive_hash->update(data, size * nmemb);
+    return t->zip->feed(data, size * nmemb) ? size * nmemb : 0;
+  }
+
+  return fwrite(data, size, nmemb, t->fp) * size;
+}
+
+} // namespace
+
+namespace faf {
+
+Downloader::Downloader(bool system_wide, size_t jobs)
+    : system_wide(system_wide), jobs(jobs == 0 ? 1 : jobs) {}
+
+bool Downloader::parse_jobs(const std::string &text, size_t &jobs) {
+  size_t value = 0;
+  const char *end = text.data() + text.size();
+  auto [ptr, ec] = std::from_chars(text.data(), end, value);
+  if (ec != std::errc() || ptr != end || value == 0 || value > MAX_JOBS) {
+    return false;
+  }
+
+  jobs = value;
+  return true;
+}
+
+void Downloader::set_store_dir(const std::filesystem::path &dir) { store_dir = dir; }
+
+void Downloader::set_subset(std::vector<codepoint_range> ranges) {
+  subset = std::move(ranges);
+}
+
+std::vector<download_result> Downloader::download(const std::vector<font_props> &fonts) {
+  Timings::Span span("download", "download");
+  std::vector<download_result> results(fonts.size());
+
+  if (fonts.empty()) {
+    return results;
+  }
+
+  TransferLoop loop(jobs);
+  if (!loop.ok()) {
+    for (auto &r : results) {
+      r.error = "could not initialize curl";
+    }
+    return results;
+  }
+
+  Manifest manifest(system_wide);
+  BlobStore store(store_dir);
+
+  std::unique_ptr<Subsetter> subsetter;
+  if (!subset.empty()) {
+    subsetter = std::make_unique<Subsetter>(subset);
+  }
+
+  // Subsets the installed file first, if asked to. The store keeps it whole.
+  auto record = [&](size_t index, const std::filesystem::path &path, std::string sha256) {
+    const font_props &font = fonts[index];
+    std::error_code ec;
+
+    if (subsetter) {
+      subset_report report = subsetter->subset(path);
+      if (report.error.empty()) {
+        sha256 = Sha256::file(path);
+      }
+      results[index].subsets.push_back(std::move(report));
+    }
+
+    manifest_entry entry;
+    entry.family = font.name;
+    entry.variant = font.prop;
+    entry.weight = font.weight;
+    entry.source = font.source;
+    entry.url = font.url;
+    entry.path = path.string();
+    entry.size = std::filesystem::file_size(path, ec);
+    entry.sha256 = sha256;
+    entry.version = font.version;
+    entry.last_modified = font.last_modified;
+    entry.installed = std::time(nullptr);
+    manifest.add(entry);
+  };
+
+  Progress progress;
+  progress.expect(fonts.size());
+  std::vector<std::unique_ptr<transfer>> transfers;
+  size_t next = 0;
+
+  TransferLoop::callbacks cb;
+
+  // Queues the next font for transfer. Returns false if nothing was queued.
+  cb.start_next = [&]() -> bool {
+    if (next >= fonts.size()) {
+      return false;
+    }
+
+    size_t index = next++;
+    const font_props &font = fonts[index];
+
+    const std::string name(font.name);
+    const std::string url(font.url);
+
+    std::filesystem::path install_dir = Common::get_install_dir(name, system_wide);
+    std::error_code ec;
+    std::filesystem::create_directories(install_dir, ec);
+
+    std::string append = font.prop.empty() ? "" : "-" + std::string(font.prop);
+    std::string file_name = name + append + std::string(font.file_format);
+
+    std::filesystem::path path = install_dir / file_name;
+    std::filesystem::path part = path;
+    part += ".part";
+    std::filesystem::path part_meta = part;
+    part_meta += ".meta";
+
+    // Someone on this machine already downloaded the very same file. Files behind
+    // URLs that may change, like those of a mirror, are only known by their hash.
+    const auto store_start = timing_clock::now();
+    std::string blob = store.find(font.immutable ? url : "", std::string(font.sha256));
+    if (!blob.empty() && store.install(blob, path)) {
+      // The install went through the part file, what described it is stale now
+      std::filesystem::remove(part_meta, ec);
+
+      progress_item *item = progress.add(file_name);
+      item->received = item->total = std::filesystem::file_size(path, ec);
+      item->state = PROGRESS_STATE::DONE;
+
+      results[index].ok = true;
+      results[index].sha256 = blob;
+      record(index, path, blob);
+      Timings::record("install from store", "download", store_start);
+      return true;
+    }
+
+    // Whatever an earlier, interrupted run left behind is resumed, if it came
+    // from the same URL
+    const std::string validator = read_part_meta(part_meta, url);
+    FILE *fp = fopen(part.c_str(), validator.empty() ? "wb" : "ab");
+    if (!fp) {
+      results[index].error = "could not open '" + part.string() + "'";
+      return true;
+    }
+
+    CURL *curl = Transfer::get().acquire();
+    if (!curl) {
+      fclose(fp);
+      results[index].error = "could not initialize curl";
+      return true;
+    }
+
+    auto t = std::make_unique<transfer>();
+    t->index = index;
+    t->progress = progress.add(file_name);
+    t->handle = curl;
+    t->fp = fp;
+    t->path = path;
+    t->part = part;
+    t->part_meta = part_meta;
+    t->url = url;
+    t->validator = validator;
+    t->headers = nullptr;
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, Transfer::read_validators);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, static_cast<void *>(&t->received));
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, transfer_write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, static_cast<void *>(t.get()));
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    // Treat a stalled transfer as broken off, so it is resumed
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, t->error);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE,
+                     static_cast<void *>(static_cast<TransferLoop::item *>(t.get())));
+
+    loop.add(t.get());
+    transfers.push_back(std::move(t));
+
+    return true;
+  };
+
+  // (Re)starts a transfer from the end of its part file
+  cb.prepare = [&](TransferLoop::item *item) {
+    transfer *t = static_cast<transfer *>(item);
+
+    // An archive is unpacked from its start again, there's nothing to resume
+    if (t->zip) {
+      t->zip->discard();
+      t->zip.reset();
+    }
+
+    fseek(t->fp, 0, SEEK_END);
+    t->offset = ftell(t->fp);
+    // Without a validator there's no telling the bytes apart from a newer file's
+    if (t->offset > 0 && t->validator.empty() && fflush(t->fp) == 0 &&
+        ftruncate(fileno(t->fp), 0) == 0) {
+      fseek(t->fp, 0, SEEK_SET);
+      t->offset = 0;
+    }
+    t->progress->received.store(t->offset, std::memory_order_relaxed);
+    t->started = false;
+    t->error[0] = '\0';
+    t->received = {};
+
+    // A file that changed since is answered with all of it, which curl reports
+    // as a range error so the transfer starts over
+    curl_slist_free_all(t->headers);
+    t->headers = nullptr;
+    if (t->offset > 0) {
+      t->headers = curl_slist_append(nullptr, ("If-Range: " + t->validator).c_str());
+    }
+    curl_easy_setopt(t->handle, CURLOPT_HTTPHEADER, t->headers);
+    curl_easy_setopt(t->handle, CURLOPT_RESUME_FROM_LARGE, t->offset);
+  };
+
+  cb.restart = [&](TransferLoop::item *item, CURLcode res) {
+    transfer *t = static_cast<transfer *>(item);
+
+    // curl takes a full response exactly as long as the part for a finished resume
+    long status = 0;
+    curl_easy_getinfo(t->handle, CURLINFO_RESPONSE_CODE, &status);
+    const bool full = res == CURLE_OK && status == 200;
+
+    // The server doesn't do ranges, or the file changed, so start over instead
+    // of resuming
+    if ((res == CURLE_RANGE_ERROR || full) && t->offset > 0 && fflush(t->fp) == 0 &&
+        ftruncate(fileno(t->fp), 0) == 0) {
+      t->validator.clear();
+      return true;
+    }
+    return false;
+  };
+
+  cb.finish = [&](TransferLoop::item *item, CURLcode res) {
+    transfer *t = static_cast<transfer *>(item);
+
+    Timings::record_transfer(t->path.filename().string(), t->handle);
+    const auto publish_start = timing_clock::now();
+
+    // The data has to be on disk before it is published under its real name
+    bool written = fflush(t->fp) == 0 && fsync(fileno(t->fp)) == 0;
+    written = fclose(t->fp) == 0 && written;
+    t->fp = nullptr;
+
+    std::error_code ec;
+    const font_props &font = fonts[t->index];
+    std::string sha256;
+    if (res == CURLE_OK && written && !t->zip) {
+      sha256 = Sha256::file(t->part);
+    }
+
+    // Only a transfer that broke off leaves its part file for next time
+    if (res == CURLE_OK || t->zip || !Transfer::is_transient(res)) {
+      std::filesystem::remove(t->part_meta, ec);
+    }
+
+    if (t->zip) {
+      // Only the fonts unpacked from the archive are kept
+      std::filesystem::remove(t->part, ec);
+      sha256 = t->archive_hash->hex_digest();
+
+      if (res == CURLE_WRITE_ERROR || (res == CURLE_OK && !t->zip->finish())) {
+        results[t->index].error = "broken or unsupported archive";
+      } else if (res != CURLE_OK) {
+        results[t->index].error = t->error[0] ? t->error : curl_easy_strerror(res);
+      } else if (t->zip->get_files().empty()) {
+        results[t->index].error = "no fonts in the archive";
+      } else if (!font.sha256.empty() && sha256 != font.sha256) {
+        results[t->index].error = "checksum mismatch, expected " + std::string(font.sha256);
+      } else {
+        results[t->index].ok = true;
+        results[t->index].sha256 = sha256;
+
+        for (const auto &file : t->zip->get_files()) {
+          record(t->index, file, Sha256::file(file));
+        }
+      }
+
+      if (!results[t->index].ok) {
+        t->zip->discard();
+      }
+      t->zip.reset();
+    } else if (res == CURLE_OK && !written) {
+      results[t->index].error = "could not write '" + t->part.string() + "'";
+    } else if (res == CURLE_OK && !font.sha256.empty() && sha256 != font.sha256) {
+      results[t->index].error = "checksum mismatch, expected " + std::string(font.sha256);
+      std::filesystem::remove(t->part, ec);
+    } else if (res == CURLE_OK) {
+      std::filesystem::rename(t->part, t->path, ec);
+      if (ec) {
+        results[t->index].error = "could not rename '" + t->part.string() + "'";
+      } else {
+        results[t->index].ok = true;
+        results[t->index].sha256 = sha256;
+
+        store.add(t->path, sha256, font.immutable ? std::string(font.url) : "");
+        record(t->index, t->path, sha256);
+      }
+    } else {
+      results[t->index].error = t->error[0] ? t->error : curl_easy_strerror(res);
+      // Only a transfer that broke off is worth resuming next time
+      if (!Transfer::is_transient(res)) {
+        std::filesystem::remove(t->part, ec);
+      }
+    }
+    t->progress->state =
+        results[t->index].ok ? PROGRESS_STATE::DONE : PROGRESS_STATE::FAILED;
+    Timings::record("publish", "download", publish_start);
+
+    curl_slist_free_all(t->headers);
+    t->headers = nullptr;
+    return results[t->index].ok;
+  };
+
+  cb.abort = [&](TransferLoop::item *item) {
+    transfer *t = static_cast<transfer *>(item);
+    results[t->index].error = "transfer aborted";
+    curl_slist_free_all(t->headers);
+    fclose(t->fp);
+  };
+
+  if (!loop.run(std::move(cb))) {
+    for (; next < fonts.size(); next++) {
+      results[next].error = "transfer aborted";
+    }
+  }
+  progress.stop();
+
+  return results;
+}
+
+} // namespace faf
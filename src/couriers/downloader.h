@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "subsetter.h"
+
+namespace faf {
+
+struct download_result {
+  bool ok = false;
+  std::string error;
+  // Hash of the file as downloaded, before any subsetting
+  std::string sha256;
+  // What subsetting made of each file installed, if asked to
+  std::vector<subset_report> subsets;
+};
+
+class Downloader {
+public:
+  // More transfers than this only crowd each other and the server
+  static constexpr size_t MAX_JOBS = 64;
+
+  Downloader(bool system_wide, size_t jobs);
+
+  // Reads the number given to --jobs, at least 1 and at most MAX_JOBS
+  static bool parse_jobs(const std::string &text, size_t &jobs);
+
+  // Shares downloaded files through the BlobStore in `dir` instead of the default
+  void set_store_dir(const std::filesystem::path &dir);
+
+  // Installs only the part of each font covering `ranges`, see Subsetter
+  void set_subset(std::vector<codepoint_range> ranges);
+
+  // Downloads every font concurrently, with up to `jobs` transfers in flight as
+  // the Scheduler sees fit. Fonts with a `sha256` are only installed if the
+  // download matches it.
+  // The returned results are in the same order as `fonts`.
+  std::vector<download_result> download(const std::vector<font_props> &fonts);
+
+private:
+  bool system_wide;
+  size_t jobs;
+  std::filesystem::path store_dir;
+  std::vector<codepoint_range> subset;
+};
+
+} // namespace faf
@@ -1,114 +1,139 @@
 #include "fontsquirrel.h"
 
-#include <curl/curl.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
 
 #include "../external/nlohmann/json.hpp"
-#include "../external/p-ranav/indicators.hpp"
+#include "../timings.h"
+#include "../util.h"
+#include "catalog.h"
 
 namespace faf {
 using json = nlohmann::json;
 
-std::vector<font_props> FontSquirrel::search(std::vector<std::string> query) {
-  indicators::show_console_cursor(false);
-  indicators::ProgressSpinner spinner{
-      indicators::option::PostfixText{"Searching..."},
-      indicators::option::ForegroundColor{indicators::Color::yellow},
-      indicators::option::ShowPercentage{false},
-      indicators::option::SpinnerStates{
-          std::vector<std::string>{"◜", "◠", "◝", "◞", "◡", "◟"}},
-      indicators::option::FontStyles{
-          std::vector<indicators::FontStyle>{indicators::FontStyle::bold}}};
-
-  auto job = [&spinner]() {
-    while (true) {
-      if (spinner.is_completed()) {
-        spinner.set_option(indicators::option::ForegroundColor{indicators::Color::green});
-        spinner.set_option(indicators::option::PrefixText{"✔"});
-        spinner.set_option(indicators::option::ShowSpinner{false});
-        spinner.set_option(indicators::option::ShowPercentage{false});
-        spinner.set_option(indicators::option::PostfixText{"Search completed"});
-        spinner.mark_as_completed();
-        break;
-      } else
-        spinner.tick();
-      std::this_thread::sleep_for(std::chrono::milliseconds(40));
-    }
-    std::cout << "\n";
-  };
-
-  std::thread thread(job);
-
-  std::vector<font_props> fonts;
-
-  CURL *curl_handle = curl_easy_init();
-  CURLcode ret;
-
-  std::string res;
+FontSquirrel::FontSquirrel() {
+  const std::string mirror_url = Mirror::get_url();
+  if (!mirror_url.empty()) {
+    catalog_url = mirror_url + "/fontsquirrel/fontlist.json";
+    download_url = mirror_url + "/fontsquirrel/fonts/";
+    return;
+  }
 
-  if (curl_handle) {
-    std::string url = "https://www.fontsquirrel.com/api/fontlist/all";
-    // for (const auto &q : query) {
-    //   url += "/" + q;
-    // }
+  const std::filesystem::path config_path(Util::get_home_dir() + "/.config/faf/config.json");
 
-    curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, Common::CurlWrite_CallbackFunc_StdString);
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &res);
+  json cfg;
+  std::ifstream stream(config_path);
+  if (!stream) {
+    return;
+  }
+  cfg = json::parse(stream, nullptr, false);
+  if (cfg.is_discarded() || !cfg.contains("fontsquirrel")) {
+    return;
+  }
 
-    ret = curl_easy_perform(curl_handle);
+  if (cfg["fontsquirrel"].contains("api_url") && cfg["fontsquirrel"]["api_url"].is_string()) {
+    catalog_url = cfg["fontsquirrel"]["api_url"];
+  }
+  if (cfg["fontsquirrel"].contains("download_url") &&
+      cfg["fontsquirrel"]["download_url"].is_string()) {
+    download_url = cfg["fontsquirrel"]["download_url"];
+  }
+}
 
-    if (ret != CURLE_OK) {
-      std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(ret) << std::endl;
+std::vector<std::vector<font_props>>
+FontSquirrel::search(std::span<const std::string> query) {
+  std::vector<std::vector<font_props>> fonts(query.size());
+
+  Catalog &catalog = catalogs.open("fontsquirrel", catalog_url, FontSquirrel::format);
+
+  Timings::Span span("fontsquirrel match", "search");
+  for (size_t q = 0; q < query.size(); q++) {
+    for (uint32_t id : match(catalog, query[q])) {
+      const catalog_family &family = catalog.family(id);
+
+      std::string at(catalog.str(family.key));
+      std::replace(at.begin(), at.end(), ' ', '-');
+      const std::string_view name = arena.store(at);
+
+      for (const auto &file : catalog.variants(family)) {
+        const std::string_view filename = catalog.str(file.key);
+        const size_t ext = filename.find_last_of('.');
+
+        fonts[q].push_back((font_props){
+            .name = name,
+            .prop = "",
+            .file_format = ext == std::string_view::npos ? "" : filename.substr(ext),
+            .url = arena.store(download_url + std::string(catalog.str(file.url))),
+            .weight = "",
+            .source = "fontsquirrel",
+            .version = "",
+            .last_modified = "",
+            .sha256 = ""});
+      }
     }
-
-    curl_easy_cleanup(curl_handle);
   }
 
-  json j = json::parse(res);
-
-  std::vector<std::string> error_fonts;
-
-  for (const auto &q : query) {
-    std::cout << "Searching for font: " << q << "\n";
-    bool found = false;
-    for (const auto &font : j) {
-      auto at = std::string(font["family_name"]);
-      std::transform(at.begin(), at.end(), at.begin(),
-                     [](unsigned char c) { return std::tolower(c); });
-      
-      if (at.find(q) == 0) {
-        for (int i = 0; i < at.size(); i++) {
-          if (at[i] == ' ') {
-            at[i] = '-';
-          }
-        }
+  return fonts;
+}
 
-        font_props f;
-        f.name = at;
-        f.file_format = std::string(font["font_filename"]).substr(
-            std::string(font["font_filename"]).find_last_of("."));
-        f.url = "https://www.fontsquirrel.com/fonts/download/" + std::string(font["family_urlname"]);
+bool FontSquirrel::mirror_to(const std::filesystem::path &dir,
+                             std::span<const std::string> filter,
+                             std::vector<mirror_file> &files) {
+  Catalog &catalog = catalogs.add();
+  if (!catalog.open("fontsquirrel", catalog_url, FontSquirrel::format) ||
+      !Mirror::export_catalog("fontsquirrel", dir, "fontsquirrel/fontlist.json")) {
+    std::cerr << "Error: could not mirror the fontsquirrel catalog" << std::endl;
+    return false;
+  }
 
-        fonts.push_back(f);
-        found = true;
-      }
+  std::vector<uint32_t> ids(catalog.index().begin(), catalog.index().end());
+  if (!filter.empty()) {
+    ids.clear();
+    for (const auto &query : filter) {
+      const auto matched = match(catalog, query);
+      ids.insert(ids.end(), matched.begin(), matched.end());
     }
+  }
 
-    if (!found) {
-      error_fonts.push_back(q);
+  // Packages are rebuilt under the same name, so they are checked for changes
+  for (uint32_t id : ids) {
+    for (const auto &file : catalog.variants(catalog.family(id))) {
+      const std::string urlname(catalog.str(file.url));
+      files.push_back({download_url + urlname, "fontsquirrel/fonts/" + urlname, false});
     }
   }
 
-  spinner.mark_as_completed();
-  thread.join();
-  indicators::show_console_cursor(true);
+  return true;
+}
 
-  for (const auto &font : error_fonts) {
-    std::cout << "\033[91mError (FontSquirrel): could not find font with the name '" << font
-              << "'\n\033[0m";
-  }
+bool FontSquirrel::preload() {
+  return catalogs.open("fontsquirrel", catalog_url, FontSquirrel::format).size() > 0;
+}
 
-  return fonts;
+bool FontSquirrel::rebuild_index() {
+  Catalog catalog;
+  return catalog.open("fontsquirrel", catalog_url, FontSquirrel::format, true);
 }
 
+const catalog_format FontSquirrel::format = {
+    .records = "",
+    .fields = {"family_name", "font_filename", "family_urlname"},
+    .add =
+        [](const catalog_record &record, CatalogBuilder &builder) {
+          auto family_name = record.fields.find("family_name");
+          auto font_filename = record.fields.find("font_filename");
+          auto family_urlname = record.fields.find("family_urlname");
+          if (family_name == record.fields.end() || font_filename == record.fields.end() ||
+              family_urlname == record.fields.end()) {
+            return;
+          }
+
+          // Every family is a single download, keyed by the name of its main font file
+          builder.add_family(family_name->second);
+          builder.add_variant(font_filename->second, family_urlname->second);
+        },
+};
+
 } // namespace faf
\ No newline at end of file
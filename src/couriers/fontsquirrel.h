@@ -1,19 +1,45 @@
 #pragma once
 
+#include <filesystem>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
+#include "../string_arena.h"
+#include "catalog.h"
 #include "common.h"
+#include "courier.h"
+#include "mirror.h"
 
 namespace faf {
 struct font_props;
 
-class FontSquirrel {
+class FontSquirrel : public Courier {
 public:
-  FontSquirrel() = default;
-  ~FontSquirrel() = default;
-  
-  std::vector<font_props> search(std::vector<std::string> query);
+  // Reads the API location from the config, if it is set there
+  FontSquirrel();
+
+  std::vector<std::vector<font_props>>
+  search(std::span<const std::string> query) override;
+
+  bool preload() override;
+
+  bool rebuild_index() override;
+
+  bool mirror_to(const std::filesystem::path &dir, std::span<const std::string> filter,
+                 std::vector<mirror_file> &files) override;
+
+private:
+  std::string catalog_url = "https://www.fontsquirrel.com/api/fontlist/all";
+  // Prefix of the packages, the catalog only keeps each family's part of the URL
+  std::string download_url = "https://www.fontsquirrel.com/fonts/download/";
+
+  CatalogSet catalogs;
+  // Strings of the results that aren't in a catalog as they are
+  StringArena arena;
+
+  static const catalog_format format;
 };
 
 } // namespace faf
\ No newline at end of file
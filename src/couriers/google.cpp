@@ -1,6 +1,5 @@
 #include "google.h"
 
-#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <curl/curl.h>
@@ -13,17 +12,34 @@
 #include <initializer_list>
 #include <iostream>
 #include <new>
+#include <sstream>
 #include <string>
-#include <thread>
 #include <vector>
 
 #include "../external/nlohmann/json.hpp"
-#include "../external/p-ranav/indicators.hpp"
+#include "../timings.h"
 #include "../util.h"
+#include "catalog.h"
+#include "catalog_cache.h"
+#include "catalog_parser.h"
+#include "transfer.h"
 
 namespace faf {
 using json = nlohmann::json;
 
+// Partial response selectors, the rest of each entry is never sent
+static const std::string FIELDS = "items(family,files,version,lastModified)";
+static const std::string VF_FIELDS = "items(family,files,axes,version,lastModified)";
+
+// Beyond this many names one catalog request is cheaper than one per name
+constexpr size_t MAX_FILTERED = 8;
+
+// Italic styles of WEIGHT_NAMES
+constexpr std::string_view ITALIC_WEIGHT_NAMES[] = {
+    "thin-italic",     "extralight-italic", "light-italic",
+    "regular-italic",  "medium-italic",     "semibold-italic",
+    "bold-italic",     "extrabold-italic",  "black-italic"};
+
 Google::Google() {
   std::string homedir = Util::get_home_dir();
 
@@ -39,10 +55,17 @@ Google::Google() {
     exit(1);
   }
 
+  mirror_url = Mirror::get_url();
+
   if (cfg.contains("google")) {
+    // Lets the catalog come from a local stand-in for the API
+    if (cfg["google"].contains("api_url") && cfg["google"]["api_url"].is_string()) {
+      api_url = cfg["google"]["api_url"];
+    }
+
     if (cfg["google"].contains("api_key") && !std::string(cfg["google"]["api_key"]).empty()) {
       api_key = cfg["google"]["api_key"];
-    } else {
+    } else if (mirror_url.empty()) {
       add_api_key(config_path);
     }
   }
@@ -79,148 +102,390 @@ bool Google::add_api_key(std::filesystem::path config_path) {
   return true;
 }
 
-std::vector<font_props> Google::search(std::vector<std::string> query) {
-  indicators::show_console_cursor(false);
-  indicators::ProgressSpinner spinner{
-      indicators::option::PostfixText{"Searching..."},
-      indicators::option::ForegroundColor{indicators::Color::yellow},
-      indicators::option::ShowPercentage{false},
-      indicators::option::SpinnerStates{
-          std::vector<std::string>{"◜", "◠", "◝", "◞", "◡", "◟"}},
-      indicators::option::FontStyles{
-          std::vector<indicators::FontStyle>{indicators::FontStyle::bold}}};
-
-  auto job = [&spinner]() {
-    while (true) {
-      if (spinner.is_completed()) {
-        spinner.set_option(indicators::option::ForegroundColor{indicators::Color::green});
-        spinner.set_option(indicators::option::PrefixText{"✔"});
-        spinner.set_option(indicators::option::ShowSpinner{false});
-        spinner.set_option(indicators::option::ShowPercentage{false});
-        spinner.set_option(indicators::option::PostfixText{"Search completed"});
-        spinner.mark_as_completed();
-        break;
-      } else
-        spinner.tick();
-      std::this_thread::sleep_for(std::chrono::milliseconds(40));
+std::vector<std::vector<font_props>> Google::search(std::span<const std::string> query) {
+  std::vector<std::vector<font_props>> rr(query.size());
+  std::vector<size_t> remaining;
+
+  // Exact names can be asked for one at a time, which is orders of magnitude less
+  // to transfer than the whole catalog. Not worth it if the cache is fresh anyway.
+  if (options.exact && query.size() <= MAX_FILTERED && mirror_url.empty() &&
+      !CatalogCache::is_offline() && !catalogs.find(catalog_name(), catalog_url()) &&
+      !CatalogCache::is_fresh(catalog_name(), catalog_url())) {
+    Catalog &filtered = catalogs.add();
+    fetch_families(query, filtered);
+
+    Timings::Span span("google match", "search");
+    for (size_t q = 0; q < query.size(); q++) {
+      if (!collect(filtered, query[q], rr[q])) {
+        remaining.push_back(q);
+      }
+    }
+  } else {
+    for (size_t q = 0; q < query.size(); q++) {
+      remaining.push_back(q);
+    }
+  }
+
+  if (remaining.empty()) {
+    return rr;
+  }
+
+  Catalog &catalog = catalogs.open(catalog_name(), catalog_url(), Google::format);
+
+  Timings::Span span("google match", "search");
+  for (size_t q : remaining) {
+    collect(catalog, query[q], rr[q]);
+  }
+
+  return rr;
+}
+
+bool Google::collect(const Catalog &catalog, std::string_view query,
+                     std::vector<font_props> &out) {
+  const std::vector<uint32_t> ids = match(catalog, query);
+
+  for (uint32_t id : ids) {
+    const catalog_family &family = catalog.family(id);
+
+    // FIXME: in the case of roboto-flex where there are no special weights
+    //        and only regular variant. The parser fails and shows "regular"
+    //        as a weight
+    std::string at(catalog.str(family.key));
+    std::replace(at.begin(), at.end(), ' ', '-');
+    const std::string_view name = arena.store(at);
+
+    if (options.variable && collect_variable(catalog, family, name, out)) {
+      continue;
+    }
+
+    for (const auto &file : catalog.variants(family)) {
+      const std::string_view url = file_url(catalog.str(file.url));
+      const std::string_view weight = weight_label(catalog.str(file.key));
+      const size_t ext = url.find_last_of('.');
+
+      out.push_back((font_props){
+          .name = name,
+          .prop = weight == "regular" || weight == "bold" || weight == "italic" ? weight : "",
+          .file_format = ext == std::string_view::npos ? "" : url.substr(ext),
+          .url = url,
+          .weight = weight,
+          .source = "google",
+          .version = catalog.str(family.version),
+          .last_modified = catalog.str(family.last_modified),
+          .sha256 = "",
+          .immutable = mirror_url.empty()});
     }
-    std::cout << "\n";
+  }
+
+  return !ids.empty();
+}
+
+std::string_view Google::file_url(std::string_view url) {
+  if (mirror_url.empty()) {
+    return url;
+  }
+  return arena.store(mirror_url + "/" + Mirror::google_path(url));
+}
+
+bool Google::mirror_to(const std::filesystem::path &dir, std::span<const std::string> filter,
+                       std::vector<mirror_file> &files) {
+  const bool was_variable = options.variable;
+  bool ok = true;
+
+  for (bool vf : {false, true}) {
+    options.variable = vf;
+    Catalog &catalog = catalogs.add();
+    if (!catalog.open(catalog_name(), catalog_url(), Google::format) ||
+        !Mirror::export_catalog(catalog_name(), dir,
+                                vf ? "google/webfonts-vf.json" : "google/webfonts.json")) {
+      std::cerr << "Error: could not mirror the " << catalog_name() << " catalog" << std::endl;
+      ok = false;
+      continue;
+    }
+
+    std::vector<uint32_t> ids(catalog.index().begin(), catalog.index().end());
+    if (!filter.empty()) {
+      ids.clear();
+      for (const auto &query : filter) {
+        const auto matched = match(catalog, query);
+        ids.insert(ids.end(), matched.begin(), matched.end());
+      }
+    }
+
+    for (uint32_t id : ids) {
+      for (const auto &file : catalog.variants(catalog.family(id))) {
+        const std::string_view url = catalog.str(file.url);
+        files.push_back({std::string(file_url(url)), Mirror::google_path(url), true});
+      }
+    }
+  }
+
+  options.variable = was_variable;
+  return ok;
+}
+
+std::string_view Google::weight_label(std::string_view key) {
+  // "700" is "bold" and "700italic" is "bold-italic", named variants stay as they are
+  if (key.size() < 3 || key[0] < '1' || key[0] > '9' || key.substr(1, 2) != "00") {
+    return key;
+  }
+
+  const size_t weight = key[0] - '1';
+  const std::string_view style = key.substr(3);
+  if (style.empty()) {
+    return WEIGHT_NAMES[weight];
+  }
+  if (style == "italic") {
+    return ITALIC_WEIGHT_NAMES[weight];
+  }
+  return arena.store(std::string(WEIGHT_NAMES[weight]) + "-" + std::string(style));
+}
+
+bool Google::collect_variable(const Catalog &catalog, const catalog_family &family,
+                              std::string_view name, std::vector<font_props> &out) {
+  int axis_min = 0;
+  int axis_max = 0;
+
+  std::string axes(catalog.str(family.axes));
+  size_t pos = 0;
+  while (!axes.empty()) {
+    pos = axes.find(',');
+    const std::string axis = axes.substr(0, pos);
+    axes.erase(0, pos == std::string::npos ? axes.size() : pos + 1);
+
+    size_t dash = axis.find('-', 5);
+    if (axis.starts_with("wght:") && dash != std::string::npos) {
+      axis_min = std::atoi(axis.c_str() + 5);
+      axis_max = std::atoi(axis.c_str() + dash + 1);
+    }
+  }
+
+  // Every named instance of a variable font points at the same file
+  struct vf_file {
+    std::string_view url;
+    bool italic;
+    int min_weight;
+    int max_weight;
   };
+  std::vector<vf_file> files;
+
+  const auto variants = catalog.variants(family);
+  for (const auto &file : variants) {
+    const std::string key(catalog.str(file.key));
+    const std::string_view url = catalog.str(file.url);
+    const bool italic = key.find("italic") != std::string::npos;
+    const int weight = std::isdigit(static_cast<unsigned char>(key[0])) ? std::atoi(key.c_str())
+                                                                        : 400;
+
+    auto it = std::find_if(files.begin(), files.end(),
+                           [&url](const vf_file &f) { return f.url == url; });
+    if (it == files.end()) {
+      files.push_back({url, italic, weight, weight});
+    } else {
+      it->italic = it->italic || italic;
+      it->min_weight = std::min(it->min_weight, weight);
+      it->max_weight = std::max(it->max_weight, weight);
+    }
+  }
+
+  // Not a variable font, or one only available as static files
+  if (files.empty() || (files.size() == variants.size() && (axis_max == 0 || files.size() > 2))) {
+    return false;
+  }
+
+  for (const auto &file : files) {
+    const size_t ext = file.url.find_last_of('.');
+    const int min_weight = axis_max ? axis_min : file.min_weight;
+    const int max_weight = axis_max ? axis_max : file.max_weight;
+
+    out.push_back((font_props){
+        .name = name,
+        .prop = file.italic ? "italic" : "regular",
+        .file_format = ext == std::string_view::npos ? "" : file.url.substr(ext),
+        .url = file_url(file.url),
+        .weight = arena.store(std::to_string(min_weight) + "-" + std::to_string(max_weight)),
+        .source = "google",
+        .min_weight = min_weight,
+        .max_weight = max_weight,
+        .version = catalog.str(family.version),
+        .last_modified = catalog.str(family.last_modified),
+        .sha256 = "",
+        .immutable = mirror_url.empty()});
+  }
 
-  std::thread thread(job);
+  return true;
+}
 
-  CURL *curl_handle = curl_easy_init();
-  CURLcode ret;
+bool Google::fetch_families(std::span<const std::string> names, Catalog &catalog) {
+  // The API only matches the exact spelling, which a stale catalog may know
+  Catalog stale;
+  stale.load(catalog_name(), Google::format);
+
+  CURLM *multi = curl_multi_init();
+  if (!multi) {
+    return false;
+  }
 
-  std::string res;
+  std::vector<CURL *> handles(names.size(), nullptr);
+  std::vector<std::string> responses(names.size());
 
-  if (curl_handle) {
-    curl_easy_setopt(curl_handle, CURLOPT_URL,
-                     std::string("https://www.googleapis.com/webfonts/v1/webfonts?key=" +
-                                 this->get_api_key())
-                         .c_str());
-    curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 0L);
-    curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0L);
+  for (size_t i = 0; i < names.size(); i++) {
+    const std::string key = Catalog::normalize(names[i]);
+
+    std::string family;
+    for (uint32_t id : stale.find_prefix(key)) {
+      if (stale.str(stale.family(id).key) == key) {
+        family = stale.str(stale.family(id).name);
+        break;
+      }
+    }
+    // Otherwise guess the usual title case, "open sans" -> "Open Sans"
+    if (family.empty()) {
+      family = key;
+      for (size_t c = 0; c < family.size(); c++) {
+        if (c == 0 || family[c - 1] == ' ') {
+          family[c] = std::toupper(static_cast<unsigned char>(family[c]));
+        }
+      }
+    }
+
+    CURL *curl_handle = Transfer::get().acquire();
+    if (!curl_handle) {
+      continue;
+    }
+
+    char *escaped = curl_easy_escape(curl_handle, family.c_str(), family.size());
+    std::string url = catalog_url() + "&family=" + escaped;
+    curl_free(escaped);
+
+    curl_easy_setopt(curl_handle, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl_handle, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_ACCEPT_ENCODING, "");
     curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION,
                      Common::CurlWrite_CallbackFunc_StdString);
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &res);
-
-    ret = curl_easy_perform(curl_handle);
-
-    curl_easy_cleanup(curl_handle);
-  }
-
-  json j = json::parse(res);
-  std::vector<font_props> rr;
-
-  std::vector<std::string> error_fonts;
-
-  for (const auto &font : query) {
-    bool found = false;
-    for (const auto &obj : j["items"]) {
-      std::string at = obj["family"];
-
-      std::transform(at.begin(), at.end(), at.begin(),
-                     [](unsigned char c) { return std::tolower(c); });
-
-      // FIXME: in the case of roboto-flex where there are no special weights
-      //        and only regular variant. The parser fails and shows "regular"
-      //        as a weight
-      if (at.find(font) == 0) {
-        found = true;
-        for (const auto &file : obj["files"].items()) {
-          std::string weight;
-
-          if (file.key().starts_with("100")) {
-            weight = "thin";
-          } else if (file.key().starts_with("200")) {
-            weight = "extralight";
-          } else if (file.key().starts_with("300")) {
-            weight = "light";
-          } else if (file.key().starts_with("400")) {
-            weight = "regular";
-          } else if (file.key().starts_with("500")) {
-            weight = "medium";
-          } else if (file.key().starts_with("600")) {
-            weight = "semibold";
-          } else if (file.key().starts_with("700")) {
-            weight = "bold";
-          } else if (file.key().starts_with("800")) {
-            weight = "extrabold";
-          } else if (file.key().starts_with("900")) {
-            weight = "black";
-          }
-
-          if (file.key().size() > 3) {
-            weight += weight.empty() ? file.key()
-                                     : "-" + file.key().substr(3, file.key().size());
-          }
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, &responses[i]);
 
-          for (int i = 0; i < at.size(); i++) {
-            if (at[i] == ' ') {
-              at[i] = '-';
-            }
-          }
+    curl_multi_add_handle(multi, curl_handle);
+    handles[i] = curl_handle;
+  }
 
-          size_t pos = 0;
-          size_t len = 0;
-          std::string prop = weight;
-          while ((pos = prop.find('-')) != std::string::npos) {
-            prop.erase(0, pos + 1);
-            len++;
-          }
-          prop.erase(0, len);
-
-          if (!(prop == "regular" || prop == "bold" || prop == "italic"))
-            prop = "";
-
-          rr.push_back((font_props){
-              .name = at,
-              .prop = prop,
-              .file_format = std::string(file.value())
-                                 .substr(std::string(file.value()).find_last_of('.'),
-                                         static_cast<std::string>(file.value()).size()),
-              .url = file.value(),
-              .weight = weight});
+  int still_running = 0;
+  do {
+    CURLMcode mc = curl_multi_perform(multi, &still_running);
+    if (mc == CURLM_OK && still_running) {
+      mc = curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+    if (mc != CURLM_OK) {
+      break;
+    }
+  } while (still_running);
+
+  CURLMsg *msg;
+  int msgs_left;
+  while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+    if (msg->msg == CURLMSG_DONE && msg->data.result != CURLE_OK) {
+      for (size_t i = 0; i < handles.size(); i++) {
+        if (handles[i] == msg->easy_handle) {
+          responses[i].clear();
         }
       }
     }
-    if (!found) {
-      error_fonts.push_back(font);
+  }
+
+  CatalogBuilder builder;
+
+  for (size_t i = 0; i < handles.size(); i++) {
+    if (!handles[i]) {
+      continue;
+    }
+    Timings::record_transfer("google family " + names[i], handles[i]);
+    curl_multi_remove_handle(multi, handles[i]);
+    Transfer::get().release(handles[i]);
+
+    // A family the API doesn't know is answered with an empty object
+    std::istringstream stream(responses[i]);
+    if (!responses[i].empty()) {
+      CatalogParser::parse(stream, Google::format, builder);
     }
   }
-  spinner.mark_as_completed();
-  thread.join();
-  indicators::show_console_cursor(true);
 
-  for (const auto &font : error_fonts) {
-    std::cout << "\033[91mError (Google): could not find font with the name '" << font
-              << "'\n\033[0m";
+  curl_multi_cleanup(multi);
+
+  return catalog.adopt(builder.build(0, 0));
+}
+
+bool Google::preload() {
+  const bool was_variable = options.variable;
+  bool ok = true;
+
+  for (bool vf : {false, true}) {
+    options.variable = vf;
+    ok = catalogs.open(catalog_name(), catalog_url(), Google::format).size() > 0 && ok;
   }
 
-  return rr;
+  options.variable = was_variable;
+  return ok;
+}
+
+bool Google::rebuild_index() {
+  Catalog catalog;
+  return catalog.open(catalog_name(), catalog_url(), Google::format, true);
 }
 
 std::string Google::get_api_key() { return api_key; }
 
+// The variable font catalog lists other files, so it is cached separately
+std::string Google::catalog_name() { return options.variable ? "google-vf" : "google"; }
+
+std::string Google::catalog_url() {
+  if (!mirror_url.empty()) {
+    return mirror_url +
+           (options.variable ? "/google/webfonts-vf.json" : "/google/webfonts.json");
+  }
+  return api_url + "?key=" + this->get_api_key() +
+         (options.variable ? "&capability=VF&fields=" + VF_FIELDS : "&fields=" + FIELDS);
+}
+
+const catalog_format Google::format = {
+    .records = "items",
+    .fields = {"family", "files", "axes", "version", "lastModified"},
+    .add =
+        [](const catalog_record &record, CatalogBuilder &builder) {
+          auto family = record.fields.find("family");
+          if (family == record.fields.end()) {
+            return;
+          }
+
+          builder.add_family(family->second);
+
+          auto version = record.fields.find("version");
+          auto last_modified = record.fields.find("lastModified");
+          builder.set_version(version == record.fields.end() ? "" : version->second,
+                              last_modified == record.fields.end() ? ""
+                                                                   : last_modified->second);
+
+          auto axes = record.objects.find("axes");
+          if (axes != record.objects.end()) {
+            std::string joined;
+            for (const auto &[key, value] : axes->second) {
+              if (key == "tag") {
+                joined += (joined.empty() ? "" : ",") + value + ":";
+              } else if (key == "start") {
+                joined += value + "-";
+              } else if (key == "end") {
+                joined += value;
+              }
+            }
+            builder.set_axes(joined);
+          }
+
+          auto files = record.objects.find("files");
+          if (files != record.objects.end()) {
+            for (const auto &[key, url] : files->second) {
+              builder.add_variant(key, url);
+            }
+          }
+        },
+};
+
 } // namespace faf
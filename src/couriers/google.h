@@ -1,26 +1,65 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "../string_arena.h"
+#include "catalog.h"
 #include "common.h"
+#include "courier.h"
+#include "mirror.h"
 
 namespace faf {
 struct font_props;
 
-class Google {
+class Google : public Courier {
 public:
   Google();
 
   std::string get_api_key();
 
-  std::vector<font_props> search(std::vector<std::string> query);
+  // Exact names are looked up with small filtered requests instead of the whole
+  // catalog when the cached one is out of date
+  std::vector<std::vector<font_props>>
+  search(std::span<const std::string> query) override;
+
+  // Opens both the static and the variable catalog
+  bool preload() override;
+
+  bool rebuild_index() override;
+
+  // Mirrors both the static and the variable catalog
+  bool mirror_to(const std::filesystem::path &dir, std::span<const std::string> filter,
+                 std::vector<mirror_file> &files) override;
 
 private:
   std::string api_key;
+  std::string api_url = "https://www.googleapis.com/webfonts/v1/webfonts";
+  // Mirror to use instead of the API and Google's servers, if any
+  std::string mirror_url;
+
+  CatalogSet catalogs;
+  // Strings of the results that aren't in a catalog as they are
+  StringArena arena;
 
   bool add_api_key(std::filesystem::path config_path);
+
+  // Name of the weight of a catalog variant like "700italic"
+  std::string_view weight_label(std::string_view key);
+
+  std::string catalog_name();
+  std::string catalog_url();
+  bool collect(const Catalog &catalog, std::string_view query, std::vector<font_props> &out);
+  // Where a file of the catalog is downloaded from
+  std::string_view file_url(std::string_view url);
+  bool collect_variable(const Catalog &catalog, const catalog_family &family,
+                        std::string_view name, std::vector<font_props> &out);
+  bool fetch_families(std::span<const std::string> names, Catalog &catalog);
+  static const catalog_format format;
 };
 
 } // namespace faf
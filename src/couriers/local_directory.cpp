@@ -0,0 +1,175 @@
+#include "local_directory.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <tuple>
+
+#include "../timings.h"
+
+namespace {
+
+constexpr std::string_view FONT_EXTENSIONS[] = {".ttf", ".otf", ".ttc", ".woff",
+                                                ".woff2"};
+
+struct local_file {
+  std::string family;
+  std::string style;
+  std::filesystem::path path;
+};
+
+bool is_font(const std::filesystem::path &path) {
+  std::string ext = path.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return std::find(std::begin(FONT_EXTENSIONS), std::end(FONT_EXTENSIONS), ext) !=
+         std::end(FONT_EXTENSIONS);
+}
+
+// "SemiBoldItalic" is "semibold-italic", "Italic" is "italic", unknown styles
+// like "Condensed" stay as they are
+std::string style_label(std::string_view style) {
+  std::string s;
+  for (char c : style) {
+    if (c != ' ' && c != '_') {
+      s += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+  }
+
+  const bool italic = s.ends_with("italic");
+  const std::string base = italic ? s.substr(0, s.size() - 6) : s;
+
+  if (base.empty() || base == "regular") {
+    return italic ? "italic" : "regular";
+  }
+  if (std::find(std::begin(faf::WEIGHT_NAMES), std::end(faf::WEIGHT_NAMES), base) !=
+      std::end(faf::WEIGHT_NAMES)) {
+    return italic ? base + "-italic" : base;
+  }
+  return s;
+}
+
+// The family and style of a font file, from its directory or its own name
+local_file describe(const std::filesystem::path &path, const std::string &family) {
+  const std::string stem = path.stem().string();
+  const size_t dash = stem.rfind('-');
+  const std::string style =
+      dash == std::string::npos ? "regular" : style_label(stem.substr(dash + 1));
+
+  return {family.empty() ? stem.substr(0, dash) : family, style, path};
+}
+
+std::string file_url(const std::filesystem::path &path) {
+  std::string url = "file://";
+  for (unsigned char c : path.string()) {
+    if (std::isalnum(c) || c == '/' || c == '-' || c == '_' || c == '.' || c == '~') {
+      url += static_cast<char>(c);
+    } else {
+      char escaped[4];
+      std::snprintf(escaped, sizeof(escaped), "%%%02X", c);
+      url += escaped;
+    }
+  }
+  return url;
+}
+
+} // namespace
+
+namespace faf {
+
+LocalDirectory::LocalDirectory(std::filesystem::path dir) {
+  std::error_code ec;
+  this->dir = std::filesystem::absolute(dir, ec);
+}
+
+std::vector<std::vector<font_props>>
+LocalDirectory::search(std::span<const std::string> query) {
+  std::vector<std::vector<font_props>> fonts(query.size());
+  Catalog &catalog = scan();
+
+  Timings::Span span("local match", "search");
+  for (size_t q = 0; q < query.size(); q++) {
+    for (uint32_t id : match(catalog, query[q])) {
+      const catalog_family &family = catalog.family(id);
+
+      std::string at(catalog.str(family.key));
+      std::replace(at.begin(), at.end(), ' ', '-');
+      const std::string_view name = arena.store(at);
+
+      for (const auto &file : catalog.variants(family)) {
+        const std::string_view url = catalog.str(file.url);
+        const std::string_view weight = catalog.str(file.key);
+        const size_t ext = url.find_last_of('.');
+        const bool named = weight == "regular" || weight == "bold" || weight == "italic";
+
+        fonts[q].push_back((font_props){
+            .name = name,
+            .prop = named ? weight : "",
+            .file_format = ext == std::string_view::npos ? "" : url.substr(ext),
+            .url = url,
+            .weight = weight,
+            .source = "local",
+            .version = "",
+            .last_modified = "",
+            .sha256 = ""});
+      }
+    }
+  }
+
+  return fonts;
+}
+
+bool LocalDirectory::preload() { return scan().size() > 0; }
+
+bool LocalDirectory::rebuild_index() {
+  listing.clear();
+  return preload();
+}
+
+Catalog &LocalDirectory::scan() {
+  Timings::Span span("local scan", "catalog");
+
+  std::vector<local_file> files;
+  std::error_code ec;
+  for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+    if (entry.is_directory(ec)) {
+      const std::string family = entry.path().filename().string();
+      for (const auto &file : std::filesystem::directory_iterator(entry.path(), ec)) {
+        if (file.is_regular_file(ec) && is_font(file.path())) {
+          files.push_back(describe(file.path(), family));
+        }
+      }
+    } else if (entry.is_regular_file(ec) && is_font(entry.path())) {
+      files.push_back(describe(entry.path(), ""));
+    }
+  }
+
+  std::sort(files.begin(), files.end(), [](const local_file &a, const local_file &b) {
+    return std::tie(a.family, a.path) < std::tie(b.family, b.path);
+  });
+
+  // A file replaced under the same name is a change too
+  std::string now;
+  for (const auto &file : files) {
+    const auto mtime = std::filesystem::last_write_time(file.path, ec).time_since_epoch();
+    now += file.path.string() + '\t' + std::to_string(mtime.count()) + '\n';
+  }
+  if (current && now == listing) {
+    return *current;
+  }
+
+  CatalogBuilder builder;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (i == 0 || files[i].family != files[i - 1].family) {
+      builder.add_family(files[i].family);
+    }
+    builder.add_variant(files[i].style, file_url(files[i].path));
+  }
+
+  current = &catalogs.add();
+  current->adopt(builder.build(0, 0));
+  listing = std::move(now);
+  return *current;
+}
+
+} // namespace faf
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../string_arena.h"
+#include "catalog.h"
+#include "common.h"
+#include "courier.h"
+
+namespace faf {
+
+// Fonts in a directory of this machine, like a share of a team's licensed fonts,
+// set with "local": {"path": "<dir>"} in the config.
+//
+// Every subdirectory is a family holding its font files, and so is every group
+// of files directly in the directory named like "<Family>-<Style>.ttf". Styles
+// are read from the file names the way Google names its weights, "Bold",
+// "SemiBoldItalic" and so on.
+class LocalDirectory : public Courier {
+public:
+  explicit LocalDirectory(std::filesystem::path dir);
+
+  std::vector<std::vector<font_props>>
+  search(std::span<const std::string> query) override;
+
+  bool preload() override;
+
+  bool rebuild_index() override;
+
+private:
+  // Lists the directory again, opening a new catalog only if anything changed
+  Catalog &scan();
+
+  std::filesystem::path dir;
+  // What the current catalog was built from
+  std::string listing;
+  Catalog *current = nullptr;
+
+  CatalogSet catalogs;
+  // Strings of the results that aren't in a catalog as they are
+  StringArena arena;
+};
+
+} // namespace faf
@@ -0,0 +1,110 @@
+#include "lockfile.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "../external/nlohmann/json.hpp"
+#include "../util.h"
+
+namespace {
+
+// A part of a file or directory name that stays in the directory it's put in
+bool is_name(const std::string &name, bool may_be_empty) {
+  if (name.empty()) {
+    return may_be_empty;
+  }
+  return name != "." && name != ".." && name.find('/') == std::string::npos &&
+         name.find('\0') == std::string::npos;
+}
+
+bool is_sha256(const std::string &hash) {
+  return hash.size() == 64 && std::all_of(hash.begin(), hash.end(), [](char c) {
+           return std::isdigit(static_cast<unsigned char>(c)) || (c >= 'a' && c <= 'f');
+         });
+}
+
+} // namespace
+
+namespace faf {
+using json = nlohmann::json;
+
+constexpr int LOCKFILE_VERSION = 1;
+
+bool Lockfile::is_lockfile(const std::string &data) {
+  json lock = json::parse(data, nullptr, false);
+  return !lock.is_discarded() && lock.is_object() && lock.contains("fonts");
+}
+
+bool Lockfile::read(const std::string &data, std::vector<font_props> &fonts,
+                    StringArena &arena) {
+  json lock = json::parse(data, nullptr, false);
+  if (lock.is_discarded() || !lock.is_object() || !lock.contains("fonts") ||
+      !lock["fonts"].is_array() ||
+      (lock.contains("version") && !lock["version"].is_number_integer()) ||
+      lock.value("version", 0) > LOCKFILE_VERSION) {
+    return false;
+  }
+
+  for (const auto &pin : lock["fonts"]) {
+    if (!pin.is_object() || !pin.contains("family") || !pin.contains("url")) {
+      return false;
+    }
+    for (const auto &[key, value] : pin.items()) {
+      if (!value.is_string()) {
+        return false;
+      }
+    }
+
+    // The family, variant and format make up where the file is installed, and
+    // the file is only installed if it is the one pinned
+    const std::string family = pin.value("family", "");
+    if (!is_name(family, false) || !is_name(pin.value("variant", ""), true) ||
+        !is_name(pin.value("format", ""), true) || pin.value("url", "").empty() ||
+        !is_sha256(pin.value("sha256", ""))) {
+      return false;
+    }
+
+    auto get = [&pin, &arena](const char *key) {
+      return arena.store(pin.value(key, ""));
+    };
+
+    fonts.push_back((font_props){.name = get("family"),
+                                 .prop = get("variant"),
+                                 .file_format = get("format"),
+                                 .url = get("url"),
+                                 .weight = get("weight"),
+                                 .source = get("source"),
+                                 .version = get("version"),
+                                 .last_modified = get("last_modified"),
+                                 .sha256 = get("sha256")});
+  }
+
+  return true;
+}
+
+bool Lockfile::write(const std::filesystem::path &path, const std::vector<font_props> &fonts,
+                     const std::vector<download_result> &results) {
+  json pins = json::array();
+
+  for (size_t i = 0; i < fonts.size() && i < results.size(); i++) {
+    if (!results[i].ok) {
+      continue;
+    }
+
+    const font_props &font = fonts[i];
+    pins.push_back({{"family", font.name},
+                    {"variant", font.prop},
+                    {"weight", font.weight},
+                    {"source", font.source},
+                    {"url", font.url},
+                    {"format", font.file_format},
+                    {"version", font.version},
+                    {"last_modified", font.last_modified},
+                    {"sha256", results[i].sha256}});
+  }
+
+  json lock = {{"version", LOCKFILE_VERSION}, {"fonts", pins}};
+  return Util::write_file(path, lock.dump(2) + "\n");
+}
+
+} // namespace faf
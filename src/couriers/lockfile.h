@@ -0,0 +1,40 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "../string_arena.h"
+#include "common.h"
+#include "downloader.h"
+
+namespace faf {
+
+// faf.lock pins the exact files of an install so it can be repeated elsewhere:
+//
+//   {
+//     "version": 1,
+//     "fonts": [
+//       {"family": "roboto", "variant": "regular", "weight": "regular",
+//        "source": "google", "url": "https://...", "format": ".ttf",
+//        "sha256": "..."}
+//     ]
+//   }
+//
+// Installing from it downloads the pinned URLs without looking at any catalog,
+// and only installs files whose hash still matches. Every pin needs a sha256, and
+// names that would install outside the font directory make the lockfile invalid.
+class Lockfile {
+public:
+  // Whether `data` is a lockfile rather than a list of font names
+  static bool is_lockfile(const std::string &data);
+
+  // The pinned fonts' strings are stored in `arena`
+  static bool read(const std::string &data, std::vector<font_props> &fonts,
+                   StringArena &arena);
+  // Pins the fonts that were installed successfully
+  static bool write(const std::filesystem::path &path, const std::vector<font_props> &fonts,
+                    const std::vector<download_result> &results);
+};
+
+} // namespace faf
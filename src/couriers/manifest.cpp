@@ -0,0 +1,187 @@
+#include "manifest.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+#include "../external/nlohmann/json.hpp"
+#include "../util.h"
+
+namespace {
+using json = nlohmann::json;
+
+// Holds an exclusive lock on `<manifest>.lock` while the log is written
+class log_lock {
+public:
+  explicit log_lock(const std::filesystem::path &path) {
+    std::filesystem::path lock_path = path;
+    lock_path += ".lock";
+    fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+      flock(fd, LOCK_EX);
+    }
+  }
+  ~log_lock() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+
+private:
+  int fd;
+};
+
+json to_json(const faf::manifest_entry &entry) {
+  return {{"family", entry.family}, {"variant", entry.variant},
+          {"weight", entry.weight}, {"source", entry.source},
+          {"url", entry.url},       {"path", entry.path},
+          {"size", entry.size},     {"sha256", entry.sha256},
+          {"version", entry.version}, {"last_modified", entry.last_modified},
+          {"installed", entry.installed}};
+}
+
+} // namespace
+
+namespace faf {
+
+Manifest::Manifest(bool system_wide) {
+  path = Util::get_data_dir() / (system_wide ? "installed-system.log" : "installed.log");
+  load();
+}
+
+bool Manifest::add(const manifest_entry &entry) {
+  // Families are looked up by family_name(), whatever spelling installed them
+  auto &files = families[family_name(entry.family)];
+  files.erase(std::remove_if(files.begin(), files.end(),
+                             [&entry](const manifest_entry &e) { return e.path == entry.path; }),
+              files.end());
+  files.push_back(entry);
+
+  return append(to_json(entry).dump());
+}
+
+bool Manifest::remove(const std::string &family, const std::string &path) {
+  auto it = families.find(family_name(family));
+  if (it != families.end()) {
+    auto &files = it->second;
+    files.erase(std::remove_if(files.begin(), files.end(),
+                               [&path](const manifest_entry &e) { return e.path == path; }),
+                files.end());
+    if (files.empty()) {
+      families.erase(it);
+    }
+  }
+
+  return append(json({{"removed", path}, {"family", family}}).dump());
+}
+
+const std::vector<manifest_entry> &Manifest::get_family(const std::string &family) const {
+  static const std::vector<manifest_entry> none;
+  auto it = families.find(family_name(family));
+  return it == families.end() ? none : it->second;
+}
+
+const std::map<std::string, std::vector<manifest_entry>> &Manifest::get_families() const {
+  return families;
+}
+
+std::string Manifest::family_name(std::string name) {
+  for (auto &c : name) {
+    c = c == ' ' ? '-' : std::tolower(static_cast<unsigned char>(c));
+  }
+  return name;
+}
+
+void Manifest::load() {
+  // Keeps others from appending between reading the log and compacting it
+  log_lock lock(path);
+
+  std::ifstream stream(path);
+  std::string line;
+
+  while (std::getline(stream, line)) {
+    json record = json::parse(line, nullptr, false);
+    // A line cut short by a crash is skipped, the ones after it still count
+    if (record.is_discarded() || !record.is_object() || !record.contains("family")) {
+      continue;
+    }
+    records++;
+
+    const std::string family = record.value("family", "");
+    const std::string key = family_name(family);
+    auto &files = families[key];
+
+    const std::string file =
+        record.contains("removed") ? record.value("removed", "") : record.value("path", "");
+    files.erase(std::remove_if(files.begin(), files.end(),
+                               [&file](const manifest_entry &e) { return e.path == file; }),
+                files.end());
+
+    if (!record.contains("removed")) {
+      manifest_entry entry;
+      entry.family = family;
+      entry.variant = record.value("variant", "");
+      entry.weight = record.value("weight", "");
+      entry.source = record.value("source", "");
+      entry.url = record.value("url", "");
+      entry.path = file;
+      entry.size = record.value("size", uint64_t(0));
+      entry.sha256 = record.value("sha256", "");
+      entry.version = record.value("version", "");
+      entry.last_modified = record.value("last_modified", "");
+      entry.installed = record.value("installed", int64_t(0));
+      files.push_back(entry);
+    }
+
+    if (files.empty()) {
+      families.erase(key);
+    }
+  }
+
+  size_t live = 0;
+  for (const auto &[family, files] : families) {
+    live += files.size();
+  }
+  if (records > 2 * live + 64) {
+    compact();
+  }
+}
+
+bool Manifest::append(const std::string &line) {
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+
+  log_lock lock(path);
+
+  // A single write to an O_APPEND file lands in one piece, even with other
+  // instances appending at the same time
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  const std::string data = line + "\n";
+  bool ok = ::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+  ::close(fd);
+
+  records++;
+  return ok;
+}
+
+void Manifest::compact() {
+  std::string data;
+  records = 0;
+  for (const auto &[family, files] : families) {
+    for (const auto &entry : files) {
+      data += to_json(entry).dump() + "\n";
+      records++;
+    }
+  }
+
+  Util::write_file(path, data);
+}
+
+} // namespace faf
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace faf {
+
+// One font file installed by faf
+struct manifest_entry {
+  std::string family; // as the install directory is named, e.g. "roboto-mono"
+  std::string variant;
+  std::string weight;
+  std::string source;
+  std::string url;
+  std::string path;
+  uint64_t size = 0;
+  std::string sha256;
+  std::string version;
+  std::string last_modified;
+  int64_t installed = 0;
+};
+
+// Record of the fonts faf installed, kept under ~/.local/share/faf/.
+//
+// The log holds one JSON object per line, either an installed file or the removal
+// of one, and is only ever appended to. It is replayed when loaded and rewritten
+// with just the installed files once removals and reinstalls dominate it.
+// System wide installs are recorded in a log of their own.
+class Manifest {
+public:
+  explicit Manifest(bool system_wide);
+
+  // Records an installed file, replacing an earlier record of the same path
+  bool add(const manifest_entry &entry);
+  // Records that a file was removed
+  bool remove(const std::string &family, const std::string &path);
+
+  // Files installed for `family`, empty if none were recorded
+  const std::vector<manifest_entry> &get_family(const std::string &family) const;
+  const std::map<std::string, std::vector<manifest_entry>> &get_families() const;
+
+  // Family name as used for install directories and manifest records
+  static std::string family_name(std::string name);
+
+private:
+  void load();
+  bool append(const std::string &line);
+  // Rewrites the log from the live entries, called with the log locked
+  void compact();
+
+  std::filesystem::path path;
+  std::map<std::string, std::vector<manifest_entry>> families;
+  // Lines in the log, compared to the live entries to decide on compaction
+  size_t records = 0;
+};
+
+} // namespace faf
@@ -0,0 +1,162 @@
+#include "matcher.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FAF_X86 1
+#endif
+
+namespace {
+
+constexpr size_t npos = std::string_view::npos;
+
+inline char fold(char c) { return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c; }
+
+// Whether the `size` bytes at `data` fold to `needle`
+inline bool equal_folded(const char *data, const char *needle, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    if (fold(data[i]) != needle[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t find_scalar(std::string_view haystack, std::string_view needle, size_t from) {
+  const size_t last = haystack.size() - needle.size();
+  for (size_t i = from; i <= last; i++) {
+    if (fold(haystack[i]) == needle[0] && equal_folded(haystack.data() + i, needle.data(),
+                                                       needle.size())) {
+      return i;
+    }
+  }
+  return npos;
+}
+
+#ifdef FAF_X86
+
+__attribute__((target("sse2"))) inline __m128i fold_sse2(__m128i x) {
+  // Unsigned (x - 'A') < 26, as a signed compare with the sign bit flipped
+  const __m128i shifted = _mm_xor_si128(_mm_sub_epi8(x, _mm_set1_epi8('A')),
+                                        _mm_set1_epi8(static_cast<char>(0x80)));
+  const __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(0x80 + 26)));
+  return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("sse2"))) size_t find_sse2(std::string_view haystack,
+                                                 std::string_view needle, size_t from) {
+  const char *data = haystack.data();
+  const size_t m = needle.size();
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[m - 1]);
+
+  size_t i = from;
+  for (; i + m - 1 + 16 <= haystack.size(); i += 16) {
+    const __m128i a = fold_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+    const __m128i b =
+        fold_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + m - 1)));
+
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                    _mm_cmpeq_epi8(b, last)));
+    while (mask) {
+      const size_t at = i + __builtin_ctz(mask);
+      if (equal_folded(data + at + 1, needle.data() + 1, m - 1)) {
+        return at;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  return i + m <= haystack.size() ? find_scalar(haystack, needle, i) : npos;
+}
+
+__attribute__((target("avx2"))) inline __m256i fold_avx2(__m256i x) {
+  const __m256i shifted = _mm256_xor_si256(_mm256_sub_epi8(x, _mm256_set1_epi8('A')),
+                                           _mm256_set1_epi8(static_cast<char>(0x80)));
+  const __m256i upper =
+      _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(0x80 + 26)), shifted);
+  return _mm256_or_si256(x, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2"))) size_t find_avx2(std::string_view haystack,
+                                                 std::string_view needle, size_t from) {
+  const char *data = haystack.data();
+  const size_t m = needle.size();
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+
+  size_t i = from;
+  for (; i + m - 1 + 32 <= haystack.size(); i += 32) {
+    const __m256i a =
+        fold_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)));
+    const __m256i b =
+        fold_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + m - 1)));
+
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+    while (mask) {
+      const size_t at = i + __builtin_ctz(mask);
+      if (equal_folded(data + at + 1, needle.data() + 1, m - 1)) {
+        return at;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  // The rest is shorter than a block
+  return i + m <= haystack.size() ? find_sse2(haystack, needle, i) : npos;
+}
+
+#endif // FAF_X86
+
+} // namespace
+
+namespace faf {
+
+Matcher::ISA Matcher::detect() {
+#ifdef FAF_X86
+  static const ISA isa = __builtin_cpu_supports("avx2")   ? ISA::AVX2
+                         : __builtin_cpu_supports("sse2") ? ISA::SSE2
+                                                          : ISA::SCALAR;
+  return isa;
+#else
+  return ISA::SCALAR;
+#endif // FAF_X86
+}
+
+size_t Matcher::find(std::string_view haystack, std::string_view needle, size_t from) {
+  return find(haystack, needle, from, detect());
+}
+
+size_t Matcher::find(std::string_view haystack, std::string_view needle, size_t from,
+                     ISA isa) {
+  if (needle.empty()) {
+    return from <= haystack.size() ? from : npos;
+  }
+  if (haystack.size() < needle.size() || from > haystack.size() - needle.size()) {
+    return npos;
+  }
+
+  switch (isa) {
+#ifdef FAF_X86
+  case ISA::AVX2:
+    return find_avx2(haystack, needle, from);
+  case ISA::SSE2:
+    return find_sse2(haystack, needle, from);
+#endif // FAF_X86
+  default:
+    return find_scalar(haystack, needle, from);
+  }
+}
+
+const char *Matcher::name(ISA isa) {
+  switch (isa) {
+  case ISA::AVX2:
+    return "avx2";
+  case ISA::SSE2:
+    return "sse2";
+  default:
+    return "scalar";
+  }
+}
+
+} // namespace faf
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace faf {
+
+// ASCII case-insensitive substring search over large buffers, such as the packed
+// family names of a catalog. The haystack is folded to lowercase on the fly, 16 or
+// 32 bytes at a time where the CPU can, and the needle has to be lowercase already.
+//
+// Candidates are found by comparing the first and last byte of the needle at
+// every position of a block at once, only those are then compared in full.
+class Matcher {
+public:
+  enum class ISA { SCALAR, SSE2, AVX2 };
+
+  // The widest implementation the CPU supports
+  static ISA detect();
+
+  // Position of the first occurrence of `needle` at or after `from`, npos if none
+  static size_t find(std::string_view haystack, std::string_view needle, size_t from = 0);
+  static size_t find(std::string_view haystack, std::string_view needle, size_t from,
+                     ISA isa);
+
+  static const char *name(ISA isa);
+};
+
+} // namespace faf
@@ -0,0 +1,284 @@
+#include "mirror.h"
+
+#include <curl/curl.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include "../external/nlohmann/json.hpp"
+#include "../progress.h"
+#include "../timings.h"
+#include "../util.h"
+#include "catalog_cache.h"
+#include "transfer.h"
+#include "transfer_loop.h"
+
+namespace {
+using json = nlohmann::json;
+
+// Every attempt starts the file over
+struct transfer : faf::TransferLoop::item {
+  const faf::mirror_file *file;
+  std::filesystem::path path;
+  std::filesystem::path part;
+  // Closed if the part file couldn't be emptied for another attempt
+  FILE *fp;
+  faf::progress_item *progress;
+  char error[CURL_ERROR_SIZE];
+};
+
+size_t write_callback(char *data, size_t size, size_t nmemb, void *userdata) {
+  transfer *t = static_cast<transfer *>(userdata);
+  if (!t->loop->take(t, size * nmemb)) {
+    return CURL_WRITEFUNC_PAUSE;
+  }
+  if (!t->fp) {
+    return 0;
+  }
+  t->progress->received.fetch_add(size * nmemb, std::memory_order_relaxed);
+  return fwrite(data, size, nmemb, t->fp) * size;
+}
+
+// Whether `path` stays below the directory it is joined onto. Paths come from the
+// catalogs, so a name like "../x" must not write outside the mirror.
+bool is_contained(const std::string &path) {
+  if (path.empty() || path.front() == '/') {
+    return false;
+  }
+  for (const auto &part : std::filesystem::path(path)) {
+    if (part == "..") {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+namespace faf {
+
+std::string Mirror::get_url() {
+  const std::filesystem::path config_path(Util::get_home_dir() + "/.config/faf/config.json");
+
+  std::ifstream stream(config_path);
+  if (!stream) {
+    return "";
+  }
+  json cfg = json::parse(stream, nullptr, false);
+  if (cfg.is_discarded() || !cfg.contains("mirror") || !cfg["mirror"].is_string()) {
+    return "";
+  }
+
+  std::string url = cfg["mirror"];
+  while (!url.empty() && url.back() == '/') {
+    url.pop_back();
+  }
+  return url;
+}
+
+std::string Mirror::google_path(std::string_view url) {
+  // Everything after the host, "https://fonts.gstatic.com/s/..." -> "s/..."
+  size_t start = url.find("://");
+  start = start == std::string_view::npos ? 0 : url.find('/', start + 3);
+  if (start == std::string_view::npos) {
+    return "";
+  }
+  return "google/files/" + std::string(url.substr(start + 1));
+}
+
+bool Mirror::export_catalog(const std::string &name, const std::filesystem::path &dir,
+                            const std::string &dest) {
+  std::string data;
+  if (!Util::read_file(CatalogCache::get_path(name), data)) {
+    return false;
+  }
+
+  // Unchanged catalogs keep their modification time, and with it their validators
+  std::string current;
+  if (Util::read_file(dir / dest, current) && current == data) {
+    return true;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories((dir / dest).parent_path(), ec);
+  return Util::write_file(dir / dest, data);
+}
+
+size_t Mirror::sync(const std::filesystem::path &dir, std::vector<mirror_file> files,
+                    size_t jobs) {
+  Timings::Span span("mirror", "download");
+
+  // The static and variable catalogs share many files
+  std::sort(files.begin(), files.end(),
+            [](const mirror_file &a, const mirror_file &b) { return a.path < b.path; });
+  files.erase(std::unique(files.begin(), files.end(),
+                          [](const mirror_file &a, const mirror_file &b) {
+                            return a.path == b.path;
+                          }),
+              files.end());
+
+  // Versioned files that are there already are done
+  std::vector<const mirror_file *> queue;
+  size_t present = 0;
+  size_t rejected = 0;
+  for (const auto &file : files) {
+    std::error_code ec;
+    if (!is_contained(file.path)) {
+      std::cerr << "Error: not mirroring '" << file.path << "', it is outside the mirror"
+                << std::endl;
+      rejected++;
+    } else if (file.immutable && std::filesystem::exists(dir / file.path, ec)) {
+      present++;
+    } else {
+      queue.push_back(&file);
+    }
+  }
+
+  TransferLoop loop(jobs);
+  if (!loop.ok()) {
+    std::cerr << "Error: could not initialize curl" << std::endl;
+    return queue.size() + rejected;
+  }
+
+  Progress progress;
+  progress.expect(queue.size());
+
+  size_t next = 0;
+  size_t fetched = 0;
+  size_t unchanged = 0;
+  std::vector<std::unique_ptr<transfer>> transfers;
+
+  TransferLoop::callbacks cb;
+
+  cb.start_next = [&]() -> bool {
+    if (next >= queue.size()) {
+      return false;
+    }
+    const mirror_file *file = queue[next++];
+
+    auto t = std::make_unique<transfer>();
+    t->file = file;
+    t->path = dir / file->path;
+    t->part = t->path;
+    t->part += ".part";
+    t->error[0] = '\0';
+
+    std::error_code ec;
+    std::filesystem::create_directories(t->path.parent_path(), ec);
+
+    t->fp = fopen(t->part.c_str(), "wb");
+    CURL *curl = t->fp ? Transfer::get().acquire() : nullptr;
+    if (!curl) {
+      if (t->fp) {
+        fclose(t->fp);
+      }
+      std::cerr << "Error: could not mirror '" << file->path << "'" << std::endl;
+      return true;
+    }
+    t->handle = curl;
+    t->progress = progress.add(file->path);
+
+    curl_easy_setopt(curl, CURLOPT_URL, file->url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, static_cast<void *>(t.get()));
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, t->error);
+    curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE,
+                     static_cast<void *>(static_cast<TransferLoop::item *>(t.get())));
+
+    // A file that is there already is only sent again if it changed since
+    struct stat st;
+    if (stat(t->path.c_str(), &st) == 0) {
+      curl_easy_setopt(curl, CURLOPT_TIMECONDITION, CURL_TIMECOND_IFMODSINCE);
+      curl_easy_setopt(curl, CURLOPT_TIMEVALUE_LARGE, static_cast<curl_off_t>(st.st_mtime));
+    }
+
+    loop.add(t.get());
+    transfers.push_back(std::move(t));
+    return true;
+  };
+
+  cb.prepare = [&](TransferLoop::item *item) {
+    transfer *t = static_cast<transfer *>(item);
+    if (t->attempts > 0 && t->fp) {
+      if (fflush(t->fp) == 0 && ftruncate(fileno(t->fp), 0) == 0) {
+        rewind(t->fp);
+      } else {
+        fclose(t->fp);
+        t->fp = nullptr;
+      }
+    }
+    t->error[0] = '\0';
+    t->progress->received.store(0, std::memory_order_relaxed);
+  };
+
+  cb.finish = [&](TransferLoop::item *item, CURLcode res) {
+    transfer *t = static_cast<transfer *>(item);
+
+    long unmet = 0;
+    curl_off_t filetime = -1;
+    curl_easy_getinfo(t->handle, CURLINFO_CONDITION_UNMET, &unmet);
+    curl_easy_getinfo(t->handle, CURLINFO_FILETIME_T, &filetime);
+    Timings::record_transfer(t->file->path, t->handle);
+
+    const bool written = t->fp && fclose(t->fp) == 0;
+    t->fp = nullptr;
+    std::error_code ec;
+
+    if (res == CURLE_OK && unmet) {
+      std::filesystem::remove(t->part, ec);
+      unchanged++;
+      t->progress->state = PROGRESS_STATE::DONE;
+      return true;
+    }
+    if (res == CURLE_OK && written && (std::filesystem::rename(t->part, t->path, ec), !ec)) {
+      // Keeps the server's time, which the next sync asks with
+      if (filetime > 0) {
+        const timespec times[2] = {{filetime, 0}, {filetime, 0}};
+        utimensat(AT_FDCWD, t->path.c_str(), times, 0);
+      }
+      fetched++;
+      t->progress->state = PROGRESS_STATE::DONE;
+      return true;
+    }
+
+    std::filesystem::remove(t->part, ec);
+    std::cerr << "Error: could not mirror '" << t->file->path << "' ("
+              << (t->error[0] ? t->error : curl_easy_strerror(res)) << ")" << std::endl;
+    t->progress->state = PROGRESS_STATE::FAILED;
+    return false;
+  };
+
+  cb.abort = [&](TransferLoop::item *item) {
+    transfer *t = static_cast<transfer *>(item);
+    if (t->fp) {
+      fclose(t->fp);
+    }
+    std::error_code ec;
+    std::filesystem::remove(t->part, ec);
+  };
+
+  loop.run(std::move(cb));
+  progress.stop();
+
+  // Whatever was left undone counts as failed
+  const size_t failed = queue.size() - fetched - unchanged + rejected;
+
+  std::cout << "Mirrored " << files.size() << " files: " << fetched << " downloaded, "
+            << present + unchanged << " unchanged";
+  if (failed > 0) {
+    std::cout << ", \033[91m" << failed << " failed\033[0m";
+  }
+  std::cout << std::endl;
+
+  return failed;
+}
+
+} // namespace faf
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace faf {
+
+// A file to keep in a mirror, at `path` below its root
+struct mirror_file {
+  std::string url;
+  std::string path;
+  // Whether the file behind the URL never changes, like Google's versioned files
+  bool immutable = false;
+};
+
+// A local copy of the catalogs and font files, made with `faf --mirror <dir>`:
+//
+//   google/webfonts.json          catalogs, as the couriers fetch them
+//   google/webfonts-vf.json
+//   google/files/s/<family>/...   font files, by their path on fonts.gstatic.com
+//   fontsquirrel/fontlist.json
+//   fontsquirrel/fonts/<family>   font packages, by their name in the catalog
+//
+// Setting "mirror" in the config to the directory as a file:// URL, or to the
+// URL of a web server serving it, makes searches and downloads use the mirror
+// instead of the public APIs.
+class Mirror {
+public:
+  // The mirror configured, empty if none
+  static std::string get_url();
+
+  // Where a font file of Google's lives below a mirror
+  static std::string google_path(std::string_view url);
+
+  // Copies the cached catalog `name` to `dest` below `dir`, unless it is the same
+  static bool export_catalog(const std::string &name, const std::filesystem::path &dir,
+                             const std::string &dest);
+
+  // Downloads the files that are missing from the mirror in `dir` or changed
+  // since, with up to `jobs` transfers at once. Returns how many failed.
+  static size_t sync(const std::filesystem::path &dir, std::vector<mirror_file> files,
+                     size_t jobs);
+};
+
+} // namespace faf
@@ -0,0 +1,113 @@
+#include "rate_limit.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+// A quarter of a second at full rate may arrive at once, but at least a full
+// chunk of curl's, or transfers would only ever get to write in debt
+constexpr double BURST_SECONDS = 0.25;
+constexpr double MIN_BURST = 16 * 1024;
+
+} // namespace
+
+namespace faf {
+
+RateLimit &RateLimit::get() {
+  static RateLimit limit;
+  return limit;
+}
+
+bool RateLimit::parse(const std::string &text, size_t &bytes_per_second) {
+  size_t digits = 0;
+  while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) {
+    digits++;
+  }
+  if (digits == 0 || digits > 12 || text.size() > digits + 1) {
+    return false;
+  }
+
+  size_t value = std::stoul(text.substr(0, digits));
+  size_t unit = 1;
+  if (text.size() > digits) {
+    switch (std::toupper(static_cast<unsigned char>(text[digits]))) {
+    case 'G':
+      unit *= 1024;
+      [[fallthrough]];
+    case 'M':
+      unit *= 1024;
+      [[fallthrough]];
+    case 'K':
+      unit *= 1024;
+      break;
+    default:
+      return false;
+    }
+  }
+
+  // A rate too large for size_t would wrap around to some small limit
+  if (__builtin_mul_overflow(value, unit, &value)) {
+    return false;
+  }
+
+  bytes_per_second = value;
+  return value > 0;
+}
+
+void RateLimit::set(size_t bytes_per_second) {
+  std::lock_guard<std::mutex> guard(mutex);
+  rate = bytes_per_second;
+  tokens = std::max(bytes_per_second * BURST_SECONDS, MIN_BURST);
+  last = std::chrono::steady_clock::now();
+}
+
+bool RateLimit::is_limited() const { return rate.load(std::memory_order_relaxed) > 0; }
+
+bool RateLimit::take(size_t bytes) {
+  if (!is_limited()) {
+    return true;
+  }
+
+  std::lock_guard<std::mutex> guard(mutex);
+  refill();
+  if (tokens <= 0) {
+    return false;
+  }
+  tokens -= bytes;
+  return true;
+}
+
+std::chrono::milliseconds RateLimit::wait() {
+  if (!is_limited()) {
+    return std::chrono::milliseconds(0);
+  }
+
+  std::lock_guard<std::mutex> guard(mutex);
+  refill();
+  if (tokens > 0) {
+    return std::chrono::milliseconds(0);
+  }
+  // Until the debt is repaid and a little more, rounded up so callers don't spin
+  const double seconds = -tokens / rate;
+  return std::chrono::milliseconds(static_cast<long>(std::ceil(seconds * 1000)) + 1);
+}
+
+void RateLimit::consume(size_t bytes) {
+  while (!take(bytes)) {
+    std::this_thread::sleep_for(wait());
+  }
+}
+
+void RateLimit::refill() {
+  const auto now = std::chrono::steady_clock::now();
+  const double elapsed = std::chrono::duration<double>(now - last).count();
+  last = now;
+
+  const double burst = std::max(rate * BURST_SECONDS, MIN_BURST);
+  tokens = std::min(tokens + elapsed * rate, burst);
+}
+
+} // namespace faf
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+namespace faf {
+
+// The bandwidth every transfer of the process shares, downloads and catalogs alike,
+// set with --limit-rate.
+//
+// A token bucket: transfers take what they receive out of it and pause while it
+// is empty, so the limit holds however many transfers are in flight. A chunk may
+// take more than is left, the bucket then stays empty until the debt is repaid.
+class RateLimit {
+public:
+  static RateLimit &get();
+
+  RateLimit(const RateLimit &) = delete;
+  RateLimit &operator=(const RateLimit &) = delete;
+
+  // Reads a rate like "500K" or "2M", in bytes (K, M and G are powers of 1024)
+  static bool parse(const std::string &text, size_t &bytes_per_second);
+
+  // 0 removes the limit
+  void set(size_t bytes_per_second);
+  bool is_limited() const;
+
+  // Takes `bytes` out of the bucket. Returns false, taking nothing, if it is
+  // empty, the transfer should then pause for wait().
+  bool take(size_t bytes);
+  std::chrono::milliseconds wait();
+  // take(), waiting as long as the bucket is empty. For blocking transfers, which
+  // have no loop of their own to unpause them from.
+  void consume(size_t bytes);
+
+private:
+  RateLimit() = default;
+
+  // Adds what accrued since the last refill, up to the burst
+  void refill();
+
+  std::atomic<size_t> rate{0};
+
+  std::mutex mutex;
+  double tokens = 0;
+  std::chrono::steady_clock::time_point last;
+};
+
+} // namespace faf
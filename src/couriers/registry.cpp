@@ -0,0 +1,303 @@
+#include "registry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <unordered_set>
+
+#include "../external/nlohmann/json.hpp"
+#include "../timings.h"
+#include "../util.h"
+#include "catalog.h"
+#include "fontsquirrel.h"
+#include "google.h"
+#include "local_directory.h"
+#include "transfer.h"
+
+namespace {
+using json = nlohmann::json;
+
+// Sources on the network get a second try if the first one seems stuck. Even a
+// cold search, fetching the whole catalog, rarely takes as long.
+constexpr faf::source_limits REMOTE_LIMITS = {std::chrono::seconds(60),
+                                              std::chrono::seconds(15)};
+constexpr faf::source_limits LOCAL_LIMITS = {std::chrono::seconds(10),
+                                             std::chrono::seconds(0)};
+
+// "timeout" and "hedge_after" of the source's section in the config, in seconds
+faf::source_limits limits_from(const json &cfg, const std::string &name,
+                               faf::source_limits limits) {
+  if (!cfg.contains(name) || !cfg[name].is_object()) {
+    return limits;
+  }
+  const json &section = cfg[name];
+  if (section.contains("timeout") && section["timeout"].is_number()) {
+    limits.timeout = std::chrono::milliseconds(
+        static_cast<long>(section["timeout"].get<double>() * 1000));
+  }
+  if (section.contains("hedge_after") && section["hedge_after"].is_number()) {
+    limits.hedge_after = std::chrono::milliseconds(
+        static_cast<long>(section["hedge_after"].get<double>() * 1000));
+  }
+  return limits;
+}
+
+} // namespace
+
+namespace faf {
+
+void Registry::add_configured() {
+  std::ifstream stream(Util::get_home_dir() + "/.config/faf/config.json");
+  json cfg = json::parse(stream, nullptr, false);
+  if (cfg.is_discarded() || !cfg.is_object()) {
+    cfg = json::object();
+  }
+
+  add("google", []() { return std::make_unique<Google>(); },
+      limits_from(cfg, "google", REMOTE_LIMITS));
+  add("fontsquirrel", []() { return std::make_unique<FontSquirrel>(); },
+      limits_from(cfg, "fontsquirrel", REMOTE_LIMITS));
+
+  if (cfg.contains("local") && cfg["local"].contains("path") &&
+      cfg["local"]["path"].is_string()) {
+    const std::filesystem::path dir = cfg["local"]["path"].get<std::string>();
+    add("local", [dir]() { return std::make_unique<LocalDirectory>(dir); },
+        limits_from(cfg, "local", LOCAL_LIMITS));
+  }
+
+  for (const auto &name : names()) {
+    if (cfg.contains(name) && cfg[name].is_object() && cfg[name].contains("enabled") &&
+        cfg[name]["enabled"].is_boolean()) {
+      set_enabled(name, cfg[name]["enabled"]);
+    }
+  }
+
+  // Sources missing from the config are still tried, after the listed ones
+  if (cfg.contains("priority") && cfg["priority"].is_array()) {
+    std::vector<std::string> order;
+    for (const auto &name : cfg["priority"]) {
+      if (name.is_string()) {
+        order.push_back(name);
+      }
+    }
+    prefer(order);
+  }
+}
+
+void Registry::add(const std::string &name, courier_factory factory,
+                   source_limits limits) {
+  auto s = std::make_shared<source>();
+  s->name = name;
+  s->factory = std::move(factory);
+  s->limits = limits;
+  sources.push_back(std::move(s));
+}
+
+bool Registry::has(const std::string &name) const { return find(name) != nullptr; }
+
+std::vector<std::string> Registry::names() const {
+  std::vector<std::string> out;
+  for (const auto &s : sources) {
+    out.push_back(s->name);
+  }
+  return out;
+}
+
+Courier *Registry::get(const std::string &name) {
+  source *s = find(name);
+  if (!s) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> guard(s->mutex);
+  if (s->couriers.empty()) {
+    s->couriers.push_back(s->factory());
+    s->idle.push_back(s->couriers.back());
+  }
+  return s->couriers.front().get();
+}
+
+void Registry::preload() {
+  for (const auto &s : sources) {
+    if (s->enabled) {
+      std::shared_ptr<Courier> courier = acquire(*s);
+      courier->preload();
+      release(*s, courier);
+    }
+  }
+}
+
+void Registry::set_enabled(const std::string &name, bool enabled) {
+  if (source *s = find(name)) {
+    s->enabled = enabled;
+  }
+}
+
+std::vector<std::string> Registry::enabled() const {
+  std::vector<std::string> out;
+  for (const auto &s : sources) {
+    if (s->enabled) {
+      out.push_back(s->name);
+    }
+  }
+  return out;
+}
+
+void Registry::prefer(const std::string &name) {
+  auto it = std::find_if(sources.begin(), sources.end(),
+                         [&name](const auto &s) { return s->name == name; });
+  if (it != sources.end()) {
+    std::rotate(sources.begin(), it, it + 1);
+  }
+}
+
+void Registry::prefer(std::span<const std::string> names) {
+  for (auto it = names.rbegin(); it != names.rend(); it++) {
+    prefer(*it);
+  }
+}
+
+search_results Registry::search(std::span<const std::string> query,
+                                const search_options &options,
+                                std::span<const std::string> only) {
+  const std::vector<std::string> items(query.begin(), query.end());
+
+  std::vector<std::pair<std::string, std::future<source_results>>> jobs;
+  for (const auto &s : sources) {
+    if (s->enabled &&
+        (only.empty() || std::find(only.begin(), only.end(), s->name) != only.end())) {
+      jobs.emplace_back(s->name, std::async(std::launch::async, run, s, items, options));
+    }
+  }
+
+  search_results results;
+  for (auto &[name, job] : jobs) {
+    results[name] = job.get();
+  }
+  return results;
+}
+
+source_results Registry::run(std::shared_ptr<source> s, std::vector<std::string> query,
+                             search_options options) {
+  // The first attempt to finish wins, the other one is cancelled. Both are joined
+  // before returning, none may outlive the search.
+  struct race {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    source_results results;
+    std::atomic<bool> cancelled{false};
+  };
+  race r;
+  std::vector<std::thread> attempts;
+
+  auto attempt = [&](std::string label) {
+    std::shared_ptr<Courier> courier = acquire(*s);
+    courier->configure(options);
+
+    attempts.emplace_back([&s, &r, &query, courier, label]() {
+      source_results results;
+      {
+        Transfer::CancelScope scope(r.cancelled);
+        Timings::Span span(label, "search");
+        results = courier->search(query);
+      }
+      release(*s, courier);
+
+      std::lock_guard<std::mutex> guard(r.mutex);
+      if (!r.done && !r.cancelled) {
+        r.done = true;
+        r.results = std::move(results);
+      }
+      r.cv.notify_all();
+    });
+  };
+
+  const auto start = std::chrono::steady_clock::now();
+  const source_limits &limits = s->limits;
+  auto finished = [&r]() { return r.done; };
+
+  attempt(s->name + " attempt");
+
+  std::unique_lock<std::mutex> lock(r.mutex);
+  if (limits.hedge_after.count() > 0 && limits.hedge_after < limits.timeout &&
+      !r.cv.wait_for(lock, limits.hedge_after, finished)) {
+    lock.unlock();
+    attempt(s->name + " hedged attempt");
+    lock.lock();
+  }
+
+  if (!r.cv.wait_until(lock, start + limits.timeout, finished)) {
+    std::cerr << "Warning: " << s->name << " did not answer within "
+              << std::chrono::duration_cast<std::chrono::seconds>(limits.timeout).count()
+              << "s, leaving it out" << std::endl;
+  }
+  r.cancelled = true;
+  lock.unlock();
+
+  for (auto &thread : attempts) {
+    thread.join();
+  }
+  return std::move(r.results);
+}
+
+std::shared_ptr<Courier> Registry::acquire(source &s) {
+  std::lock_guard<std::mutex> guard(s.mutex);
+  if (!s.idle.empty()) {
+    std::shared_ptr<Courier> courier = std::move(s.idle.back());
+    s.idle.pop_back();
+    return courier;
+  }
+
+  s.couriers.push_back(s.factory());
+  return s.couriers.back();
+}
+
+void Registry::release(source &s, std::shared_ptr<Courier> courier) {
+  std::lock_guard<std::mutex> guard(s.mutex);
+  s.idle.push_back(std::move(courier));
+}
+
+source_results Registry::merge(const search_results &results,
+                               std::span<const std::string> order, size_t query_count) {
+  source_results merged(query_count);
+
+  for (size_t q = 0; q < query_count; q++) {
+    std::unordered_set<std::string> seen;
+
+    for (const auto &name : order) {
+      auto it = results.find(name);
+      if (it == results.end() || q >= it->second.size()) {
+        continue;
+      }
+
+      // All files of a family come from the same source
+      std::unordered_set<std::string> found;
+      for (const auto &font : it->second[q]) {
+        std::string family = Catalog::normalize(font.name);
+        if (!seen.count(family)) {
+          merged[q].push_back(font);
+          found.insert(std::move(family));
+        }
+      }
+      seen.insert(found.begin(), found.end());
+    }
+  }
+
+  return merged;
+}
+
+Registry::source *Registry::find(const std::string &name) const {
+  for (const auto &s : sources) {
+    if (s->name == name) {
+      return s.get();
+    }
+  }
+  return nullptr;
+}
+
+} // namespace faf
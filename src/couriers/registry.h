@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "courier.h"
+
+namespace faf {
+
+// Results of one source, per query
+using source_results = std::vector<std::vector<font_props>>;
+// Results of every source searched, by the name of the source
+using search_results = std::map<std::string, source_results>;
+
+using courier_factory = std::function<std::unique_ptr<Courier>()>;
+
+struct source_limits {
+  // A source that hasn't answered by then is left out of the results
+  std::chrono::milliseconds timeout{60000};
+  // A second attempt is started if the first one hasn't answered by then,
+  // whichever finishes first is used. 0 never starts one.
+  std::chrono::milliseconds hedge_after{0};
+};
+
+// The sources faf searches, in the order they are preferred.
+//
+// A search goes out to all enabled sources at once. Each runs on couriers of its
+// own, made by the source's factory when none is idle, so a slow attempt that
+// was given up on never holds up the next search.
+class Registry {
+public:
+  // Adds a source, preferred after the ones added before it
+  void add(const std::string &name, courier_factory factory, source_limits limits = {});
+
+  // Adds the sources faf knows, with the limits, order and sources enabled as
+  // the config sets them. New sources are registered here.
+  void add_configured();
+
+  bool has(const std::string &name) const;
+  // Every source in order of preference
+  std::vector<std::string> names() const;
+
+  // A courier of the source, always the same one, for what only one of them does
+  Courier *get(const std::string &name);
+
+  // Opens the catalogs of the enabled sources, or brings them up to date, on an
+  // idle courier of each. Safe to call while searches run.
+  void preload();
+
+  void set_enabled(const std::string &name, bool enabled);
+  // The enabled sources in order of preference
+  std::vector<std::string> enabled() const;
+
+  // Moves `name` to the front, or the sources listed to the front in their order
+  void prefer(const std::string &name);
+  void prefer(std::span<const std::string> names);
+
+  // Searches the enabled sources concurrently, or of them only those in `only` if
+  // it isn't empty. The results stay valid as long as the registry. Safe to call
+  // from several threads at once.
+  search_results search(std::span<const std::string> query, const search_options &options,
+                        std::span<const std::string> only = {});
+
+  // Per query, every family the sources found, each taken from the first source
+  // in `order` that has it. Families are the same if their normalized names are.
+  static source_results merge(const search_results &results,
+                              std::span<const std::string> order, size_t query_count);
+
+private:
+  struct source {
+    std::string name;
+    courier_factory factory;
+    source_limits limits;
+    bool enabled = true;
+
+    std::mutex mutex;
+    // Every courier made for this source, kept since results point into them
+    std::vector<std::shared_ptr<Courier>> couriers;
+    std::vector<std::shared_ptr<Courier>> idle;
+  };
+
+  static std::shared_ptr<Courier> acquire(source &s);
+  static void release(source &s, std::shared_ptr<Courier> courier);
+  static source_results run(std::shared_ptr<source> s, std::vector<std::string> query,
+                            search_options options);
+
+  source *find(const std::string &name) const;
+
+  std::vector<std::shared_ptr<source>> sources;
+};
+
+} // namespace faf
@@ -0,0 +1,84 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+namespace {
+
+// The window a batch starts at, the old fixed number of jobs
+constexpr size_t INITIAL_WINDOW = 4;
+// A larger window has to be this much faster to count as an improvement
+constexpr double GAIN = 1.05;
+// How much the best throughput fades per round that didn't beat it
+constexpr double FADE = 0.9;
+
+constexpr std::chrono::milliseconds BACKOFF_BASE(500);
+constexpr std::chrono::milliseconds BACKOFF_MAX(30000);
+
+} // namespace
+
+namespace faf {
+
+Scheduler::Scheduler(size_t max_jobs)
+    : max_jobs(std::max<size_t>(max_jobs, 1)),
+      current(std::min(this->max_jobs, INITIAL_WINDOW)),
+      round_start(std::chrono::steady_clock::now()), best_window(current),
+      random(std::random_device()()) {}
+
+size_t Scheduler::window() const { return current; }
+
+size_t Scheduler::started() { return decreases; }
+
+void Scheduler::received(size_t bytes) { this->bytes += bytes; }
+
+void Scheduler::succeeded() {
+  if (++finished < current) {
+    return;
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(now - round_start).count();
+  const double rate = seconds > 0 ? bytes / seconds : 0;
+  finished = 0;
+  bytes = 0;
+  round_start = now;
+
+  if (rate > best_rate * GAIN) {
+    best_rate = rate;
+    best_window = current;
+    current = std::min(current + 1, max_jobs);
+  } else {
+    // More transfers didn't make it faster, the link or the server is saturated
+    best_rate *= FADE;
+    current = best_window;
+  }
+}
+
+void Scheduler::congested(size_t round) {
+  if (round != decreases) {
+    return;
+  }
+  decreases++;
+
+  current = std::max<size_t>(current / 2, 1);
+  best_window = current;
+  best_rate = 0;
+  finished = 0;
+  bytes = 0;
+  round_start = std::chrono::steady_clock::now();
+}
+
+std::chrono::milliseconds Scheduler::backoff(int attempts,
+                                             std::chrono::seconds retry_after) {
+  if (retry_after.count() > 0) {
+    std::uniform_int_distribution<long> jitter(0, 1000);
+    return retry_after + std::chrono::milliseconds(jitter(random));
+  }
+
+  // Full jitter, anywhere up to the exponential backoff
+  const long doubled = BACKOFF_BASE.count() << std::clamp(attempts - 1, 0, 10);
+  const long ceiling = std::min<long>(doubled, BACKOFF_MAX.count());
+  std::uniform_int_distribution<long> delay(0, ceiling);
+  return std::chrono::milliseconds(delay(random));
+}
+
+} // namespace faf
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <random>
+
+namespace faf {
+
+// Paces one batch of transfers, like the fonts of a Downloader::download call.
+//
+// The number of transfers in flight adapts to what the servers and the link can
+// take: it grows by one per round of transfers while that still raises the
+// throughput, and halves when a server asks to slow down or connections break
+// off. Retries wait a jittered, growing backoff so they don't arrive together.
+class Scheduler {
+public:
+  explicit Scheduler(size_t max_jobs);
+
+  // How many transfers may be in flight now
+  size_t window() const;
+
+  // Marks the start of a transfer (or one of its attempts), returns what
+  // congested() wants to know about it
+  size_t started();
+  // Counts data received, the throughput each round is judged by
+  void received(size_t bytes);
+  // A transfer finished well
+  void succeeded();
+  // A server answered 429 or 503, or a connection broke off, for a transfer
+  // started at `round`. Transfers in flight at the same time only count once.
+  void congested(size_t round);
+
+  // How long to wait before the next attempt of a transfer that made `attempts`
+  // already. A server's Retry-After is honoured, jittered a little as well.
+  std::chrono::milliseconds backoff(int attempts, std::chrono::seconds retry_after);
+
+private:
+  size_t max_jobs;
+  size_t current;
+
+  // Bumped by every decrease, transfers started before it don't decrease again
+  size_t decreases = 0;
+
+  // The round in progress, `current` transfers long
+  size_t finished = 0;
+  size_t bytes = 0;
+  std::chrono::steady_clock::time_point round_start;
+
+  // The best throughput of a round so far, which fades so the window probes
+  // upwards again once in a while, and the window it was reached at
+  double best_rate = 0;
+  size_t best_window;
+
+  std::mt19937 random;
+};
+
+} // namespace faf
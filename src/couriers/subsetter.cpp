@@ -0,0 +1,836 @@
+#include "subsetter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <unordered_map>
+
+#include "../timings.h"
+#include "../util.h"
+
+namespace {
+
+constexpr uint32_t make_tag(const char (&name)[5]) {
+  return uint32_t(uint8_t(name[0])) << 24 | uint32_t(uint8_t(name[1])) << 16 |
+         uint32_t(uint8_t(name[2])) << 8 | uint8_t(name[3]);
+}
+
+constexpr uint32_t TRUETYPE = 0x00010000;
+constexpr uint32_t APPLE_TRUETYPE = make_tag("true");
+constexpr uint32_t OPENTYPE_CFF = make_tag("OTTO");
+constexpr uint32_t COLLECTION = make_tag("ttcf");
+constexpr uint32_t WOFF = make_tag("wOFF");
+constexpr uint32_t WOFF2 = make_tag("wOF2");
+
+constexpr uint32_t CMAP = make_tag("cmap");
+constexpr uint32_t DSIG = make_tag("DSIG");
+constexpr uint32_t GLYF = make_tag("glyf");
+constexpr uint32_t GVAR = make_tag("gvar");
+constexpr uint32_t HEAD = make_tag("head");
+constexpr uint32_t HHEA = make_tag("hhea");
+constexpr uint32_t HMTX = make_tag("hmtx");
+constexpr uint32_t LOCA = make_tag("loca");
+constexpr uint32_t MAXP = make_tag("maxp");
+constexpr uint32_t NAME = make_tag("name");
+constexpr uint32_t OS2 = make_tag("OS/2");
+constexpr uint32_t POST = make_tag("post");
+
+// Whole font checksums add up to this, set in head's checkSumAdjustment
+constexpr uint32_t CHECKSUM_MAGIC = 0xB1B0AFBA;
+
+// Flags of a composite glyph's components
+constexpr uint16_t ARG_1_AND_2_ARE_WORDS = 0x0001;
+constexpr uint16_t WE_HAVE_A_SCALE = 0x0008;
+constexpr uint16_t MORE_COMPONENTS = 0x0020;
+constexpr uint16_t WE_HAVE_AN_X_AND_Y_SCALE = 0x0040;
+constexpr uint16_t WE_HAVE_A_TWO_BY_TWO = 0x0080;
+
+struct cmap_entry {
+  uint32_t codepoint;
+  uint16_t glyph;
+};
+
+// Reads past the end give 0, a broken font comes out broken but never crashes
+uint16_t be16(std::string_view s, size_t at) {
+  if (at >= s.size() || s.size() - at < 2) {
+    return 0;
+  }
+  return uint16_t(uint8_t(s[at])) << 8 | uint8_t(s[at + 1]);
+}
+
+uint32_t be32(std::string_view s, size_t at) {
+  return uint32_t(be16(s, at)) << 16 | be16(s, at + 2);
+}
+
+void put16(std::string &s, uint16_t value) {
+  s += static_cast<char>(value >> 8);
+  s += static_cast<char>(value & 0xFF);
+}
+
+void put32(std::string &s, uint32_t value) {
+  put16(s, value >> 16);
+  put16(s, value & 0xFFFF);
+}
+
+void set16(std::string &s, size_t at, uint16_t value) {
+  s[at] = static_cast<char>(value >> 8);
+  s[at + 1] = static_cast<char>(value & 0xFF);
+}
+
+void set32(std::string &s, size_t at, uint32_t value) {
+  set16(s, at, value >> 16);
+  set16(s, at + 2, value & 0xFFFF);
+}
+
+void pad4(std::string &s) { s.append((4 - s.size() % 4) % 4, '\0'); }
+
+uint32_t checksum(std::string_view data) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < data.size(); i += 4) {
+    uint32_t word = 0;
+    for (size_t j = i; j < i + 4; j++) {
+      word = word << 8 | (j < data.size() ? uint8_t(data[j]) : 0);
+    }
+    sum += word;
+  }
+  return sum;
+}
+
+bool parse_hex(std::string_view s, uint32_t &value) {
+  if (s.empty() || s.size() > 6) {
+    return false;
+  }
+  value = 0;
+  for (char c : s) {
+    if (!std::isxdigit(static_cast<unsigned char>(c))) {
+      return false;
+    }
+    value = value << 4 | (std::isdigit(static_cast<unsigned char>(c))
+                              ? c - '0'
+                              : std::tolower(static_cast<unsigned char>(c)) - 'a' + 10);
+  }
+  return true;
+}
+
+bool covers(const std::vector<faf::codepoint_range> &ranges, uint32_t codepoint) {
+  auto it = std::upper_bound(
+      ranges.begin(), ranges.end(), codepoint,
+      [](uint32_t cp, const faf::codepoint_range &range) { return cp < range.first; });
+  return it != ranges.begin() && codepoint <= std::prev(it)->last;
+}
+
+// The glyphs of `wanted` codepoints in the best Unicode subtable of cmap, formats
+// 4, 6 and 12 are read
+bool read_cmap(std::string_view cmap, const std::vector<faf::codepoint_range> &wanted,
+               uint16_t num_glyphs, std::vector<cmap_entry> &entries,
+               std::string &error) {
+  std::string_view best;
+  int best_score = 0;
+  for (size_t i = 0, count = be16(cmap, 2); i < count; i++) {
+    const uint16_t platform = be16(cmap, 4 + i * 8);
+    const uint16_t encoding = be16(cmap, 6 + i * 8);
+    const uint32_t offset = be32(cmap, 8 + i * 8);
+    if (offset >= cmap.size()) {
+      continue;
+    }
+    const std::string_view sub = cmap.substr(offset);
+    const uint16_t format = be16(sub, 0);
+
+    int score = 0;
+    if (platform == 3 && encoding == 10 && format == 12) {
+      score = 5;
+    } else if (platform == 0 && format == 12) {
+      score = 4;
+    } else if (platform == 3 && encoding == 1 && (format == 4 || format == 6)) {
+      score = 3;
+    } else if (platform == 0 && (format == 4 || format == 6)) {
+      score = 2;
+    } else if (platform == 3 && encoding == 0) {
+      score = 1;
+    }
+    if (score > best_score) {
+      best = sub;
+      best_score = score;
+    }
+  }
+
+  if (best_score == 0) {
+    error = "no Unicode cmap";
+    return false;
+  }
+  // Their codepoints are private ones standing in for symbols, no script's
+  if (best_score == 1) {
+    error = "symbol fonts are left alone";
+    return false;
+  }
+
+  auto add = [&](uint32_t codepoint, uint32_t glyph) {
+    if (glyph != 0 && glyph < num_glyphs && covers(wanted, codepoint)) {
+      entries.push_back({codepoint, static_cast<uint16_t>(glyph)});
+    }
+  };
+
+  const uint16_t format = be16(best, 0);
+  if (format == 4) {
+    const size_t segments = be16(best, 6) / 2;
+    const size_t ends = 14;
+    const size_t starts = ends + segments * 2 + 2;
+    const size_t deltas = starts + segments * 2;
+    const size_t range_offsets = deltas + segments * 2;
+
+    for (size_t i = 0; i < segments; i++) {
+      const uint32_t end = be16(best, ends + i * 2);
+      const uint32_t start = be16(best, starts + i * 2);
+      const uint16_t delta = be16(best, deltas + i * 2);
+      const uint16_t range_offset = be16(best, range_offsets + i * 2);
+
+      for (uint32_t cp = start; cp <= end && cp != 0xFFFF; cp++) {
+        if (!covers(wanted, cp)) {
+          continue;
+        }
+        uint16_t glyph = cp + delta;
+        if (range_offset != 0) {
+          glyph = be16(best, range_offsets + i * 2 + range_offset + (cp - start) * 2);
+          glyph = glyph == 0 ? 0 : glyph + delta;
+        }
+        add(cp, glyph);
+      }
+    }
+  } else if (format == 6) {
+    const uint32_t first = be16(best, 6);
+    for (uint32_t i = 0, count = be16(best, 8); i < count; i++) {
+      add(first + i, be16(best, 10 + i * 2));
+    }
+  } else {
+    const size_t groups = std::min<size_t>(be32(best, 12), best.size() / 12);
+    for (size_t i = 0; i < groups; i++) {
+      const uint32_t start = be32(best, 16 + i * 12);
+      const uint32_t end = std::min<uint32_t>(be32(best, 20 + i * 12), 0x10FFFF);
+      const uint32_t glyph = be32(best, 24 + i * 12);
+
+      // Only the part of the group that is wanted, groups can span planes
+      auto range = std::lower_bound(
+          wanted.begin(), wanted.end(), start,
+          [](const faf::codepoint_range &r, uint32_t cp) { return r.last < cp; });
+      for (; range != wanted.end() && range->first <= end; range++) {
+        const uint32_t last = std::min(end, range->last);
+        for (uint32_t cp = std::max(start, range->first); cp <= last; cp++) {
+          add(cp, glyph + (cp - start));
+        }
+      }
+    }
+  }
+
+  std::sort(entries.begin(), entries.end(), [](const cmap_entry &a, const cmap_entry &b) {
+    return a.codepoint < b.codepoint;
+  });
+  entries.erase(std::unique(entries.begin(), entries.end(),
+                            [](const cmap_entry &a, const cmap_entry &b) {
+                              return a.codepoint == b.codepoint;
+                            }),
+                entries.end());
+  return true;
+}
+
+// Format 4 for the Basic Multilingual Plane. Runs of codepoints whose glyphs
+// follow each other are segments of their own, other runs list their glyphs.
+// Returns false if the subtable would outgrow its 16 bit length.
+bool build_cmap4(const std::vector<cmap_entry> &entries, std::string &out) {
+  struct segment {
+    uint16_t start, end, delta;
+    // Index of the first glyph in the glyph array, or -1 for a delta segment
+    int array_start;
+  };
+  std::vector<segment> segments;
+  std::vector<uint16_t> glyphs;
+
+  size_t i = 0;
+  while (i < entries.size() && entries[i].codepoint < 0xFFFF) {
+    // A run of consecutive codepoints, and how many glyph runs it has
+    size_t end = i + 1;
+    size_t glyph_runs = 1;
+    while (end < entries.size() && entries[end].codepoint <= 0xFFFE &&
+           entries[end].codepoint == entries[end - 1].codepoint + 1) {
+      glyph_runs += entries[end].glyph != entries[end - 1].glyph + 1;
+      end++;
+    }
+
+    // A segment costs 8 bytes, a glyph in the array 2
+    if (glyph_runs * 8 <= 8 + (end - i) * 2) {
+      for (size_t s = i; s < end;) {
+        size_t e = s + 1;
+        while (e < end && entries[e].glyph == entries[e - 1].glyph + 1) {
+          e++;
+        }
+        segments.push_back({static_cast<uint16_t>(entries[s].codepoint),
+                            static_cast<uint16_t>(entries[e - 1].codepoint),
+                            static_cast<uint16_t>(entries[s].glyph -
+                                                  entries[s].codepoint),
+                            -1});
+        s = e;
+      }
+    } else {
+      segments.push_back({static_cast<uint16_t>(entries[i].codepoint),
+                          static_cast<uint16_t>(entries[end - 1].codepoint), 0,
+                          static_cast<int>(glyphs.size())});
+      for (size_t s = i; s < end; s++) {
+        glyphs.push_back(entries[s].glyph);
+      }
+    }
+    i = end;
+  }
+  // Every format 4 subtable ends with this one
+  segments.push_back({0xFFFF, 0xFFFF, 1, -1});
+
+  const size_t count = segments.size();
+  const size_t length = 16 + count * 8 + glyphs.size() * 2;
+  if (length > 0xFFFF) {
+    return false;
+  }
+
+  uint16_t selector = 0;
+  while ((2u << selector) <= count) {
+    selector++;
+  }
+  const uint16_t search_range = 2 << selector;
+
+  put16(out, 4);
+  put16(out, length);
+  put16(out, 0);
+  put16(out, count * 2);
+  put16(out, search_range);
+  put16(out, selector);
+  put16(out, count * 2 - search_range);
+  for (const auto &s : segments) {
+    put16(out, s.end);
+  }
+  put16(out, 0);
+  for (const auto &s : segments) {
+    put16(out, s.start);
+  }
+  for (const auto &s : segments) {
+    put16(out, s.delta);
+  }
+  for (size_t i = 0; i < count; i++) {
+    // From the entry itself to its first glyph in the array
+    put16(out, segments[i].array_start < 0
+                   ? 0
+                   : (count - i + segments[i].array_start) * 2);
+  }
+  for (uint16_t glyph : glyphs) {
+    put16(out, glyph);
+  }
+  return true;
+}
+
+// Format 12, for everything
+void build_cmap12(const std::vector<cmap_entry> &entries, std::string &out) {
+  std::string groups;
+  size_t count = 0;
+  for (size_t i = 0; i < entries.size();) {
+    size_t end = i + 1;
+    while (end < entries.size() &&
+           entries[end].codepoint == entries[end - 1].codepoint + 1 &&
+           entries[end].glyph == entries[end - 1].glyph + 1) {
+      end++;
+    }
+    put32(groups, entries[i].codepoint);
+    put32(groups, entries[end - 1].codepoint);
+    put32(groups, entries[i].glyph);
+    count++;
+    i = end;
+  }
+
+  put16(out, 12);
+  put16(out, 0);
+  put32(out, 16 + groups.size());
+  put32(out, 0);
+  put32(out, count);
+  out += groups;
+}
+
+std::string build_cmap(const std::vector<cmap_entry> &entries) {
+  std::string format4;
+  std::string format12;
+  const bool fits = build_cmap4(entries, format4);
+  if (!fits || entries.back().codepoint > 0xFFFF) {
+    build_cmap12(entries, format12);
+  }
+
+  // Unicode and Windows records for each subtable, sorted as they have to be
+  std::vector<std::pair<uint32_t, const std::string *>> records;
+  if (fits) {
+    records.push_back({0 << 16 | 3, &format4});
+  }
+  if (!format12.empty()) {
+    records.push_back({0 << 16 | 4, &format12});
+  }
+  if (fits) {
+    records.push_back({3 << 16 | 1, &format4});
+  }
+  if (!format12.empty()) {
+    records.push_back({3 << 16 | 10, &format12});
+  }
+
+  const size_t format4_offset = 4 + records.size() * 8;
+  const size_t format12_offset = format4_offset + format4.size();
+
+  std::string out;
+  put16(out, 0);
+  put16(out, records.size());
+  for (const auto &[encoding, table] : records) {
+    put32(out, encoding);
+    put32(out, table == &format4 ? format4_offset : format12_offset);
+  }
+  out += format4;
+  out += format12;
+  return out;
+}
+
+// Adds the components of every composite glyph kept, and theirs
+void close_composites(std::string_view glyf, const std::vector<uint32_t> &loca,
+                      std::vector<bool> &keep) {
+  std::vector<uint16_t> pending;
+  for (size_t glyph = 0; glyph < keep.size(); glyph++) {
+    if (keep[glyph]) {
+      pending.push_back(glyph);
+    }
+  }
+
+  while (!pending.empty()) {
+    const uint16_t glyph = pending.back();
+    pending.pop_back();
+
+    const std::string_view data = glyf.substr(loca[glyph], loca[glyph + 1] - loca[glyph]);
+    if (data.size() < 10 || static_cast<int16_t>(be16(data, 0)) >= 0) {
+      continue;
+    }
+
+    uint16_t flags;
+    size_t at = 10;
+    do {
+      flags = be16(data, at);
+      const uint16_t component = be16(data, at + 2);
+      at += 4 + (flags & ARG_1_AND_2_ARE_WORDS ? 4 : 2);
+      at += flags & WE_HAVE_A_SCALE            ? 2
+            : flags & WE_HAVE_AN_X_AND_Y_SCALE ? 4
+            : flags & WE_HAVE_A_TWO_BY_TWO     ? 8
+                                               : 0;
+
+      if (component < keep.size() && !keep[component]) {
+        keep[component] = true;
+        pending.push_back(component);
+      }
+    } while (flags & MORE_COMPONENTS && at < data.size());
+  }
+}
+
+// The horizontal metrics with the long ones ending at the last glyph kept, the
+// glyphs after it only keep a left side bearing, 0 as they are empty
+bool build_hmtx(std::string_view hmtx, std::string_view hhea,
+                const std::vector<bool> &keep, std::string &hmtx_out,
+                std::string &hhea_out) {
+  const size_t glyphs = keep.size();
+  const size_t metrics = be16(hhea, 34);
+  if (hhea.size() < 36 || metrics == 0 || metrics > glyphs ||
+      hmtx.size() < metrics * 4 + (glyphs - metrics) * 2) {
+    return false;
+  }
+
+  size_t last = 0;
+  for (size_t glyph = 0; glyph < glyphs; glyph++) {
+    if (keep[glyph]) {
+      last = glyph;
+    }
+  }
+  const size_t kept_metrics = std::min(metrics, last + 1);
+
+  hmtx_out.assign(hmtx.substr(0, kept_metrics * 4));
+  for (size_t glyph = kept_metrics; glyph < glyphs; glyph++) {
+    const size_t at =
+        glyph < metrics ? glyph * 4 + 2 : metrics * 4 + (glyph - metrics) * 2;
+    put16(hmtx_out, keep[glyph] ? be16(hmtx, at) : 0);
+  }
+
+  hhea_out.assign(hhea);
+  set16(hhea_out, 34, kept_metrics);
+  return true;
+}
+
+// gvar with the variations of the glyphs dropped left out. Returns false if the
+// table doesn't look right, it is then kept as it is.
+bool build_gvar(std::string_view gvar, const std::vector<bool> &keep, std::string &out) {
+  const size_t glyphs = keep.size();
+  const uint16_t axes = be16(gvar, 4);
+  const uint16_t shared_count = be16(gvar, 6);
+  const uint32_t shared_offset = be32(gvar, 8);
+  const uint16_t flags = be16(gvar, 14);
+  const uint32_t data_offset = be32(gvar, 16);
+  const bool long_offsets = flags & 1;
+
+  if (gvar.size() < 20 || be16(gvar, 12) != glyphs || data_offset > gvar.size() ||
+      shared_offset > gvar.size() ||
+      gvar.size() - shared_offset < shared_count * axes * 2u) {
+    return false;
+  }
+
+  std::vector<uint32_t> offsets(glyphs + 1);
+  for (size_t glyph = 0; glyph <= glyphs; glyph++) {
+    offsets[glyph] =
+        long_offsets ? be32(gvar, 20 + glyph * 4) : be16(gvar, 20 + glyph * 2) * 2u;
+    if ((glyph > 0 && offsets[glyph] < offsets[glyph - 1]) ||
+        offsets[glyph] > gvar.size() - data_offset) {
+      return false;
+    }
+  }
+
+  const std::string_view shared = gvar.substr(shared_offset, shared_count * axes * 2u);
+  std::string data;
+  std::vector<uint32_t> kept(glyphs + 1);
+  for (size_t glyph = 0; glyph < glyphs; glyph++) {
+    kept[glyph] = data.size();
+    if (keep[glyph]) {
+      data +=
+          gvar.substr(data_offset + offsets[glyph], offsets[glyph + 1] - offsets[glyph]);
+      data.append(data.size() % 2, '\0');
+    }
+  }
+  kept[glyphs] = data.size();
+
+  const size_t new_shared_offset = 20 + (glyphs + 1) * 4;
+  out.assign(gvar.substr(0, 20));
+  set32(out, 8, new_shared_offset);
+  set16(out, 14, flags | 1);
+  set32(out, 16, new_shared_offset + shared.size());
+  for (uint32_t offset : kept) {
+    put32(out, offset);
+  }
+  out += shared;
+  out += data;
+  return true;
+}
+
+// name without the legacy Mac records, if there are Windows ones to read instead
+std::string build_name(std::string_view name) {
+  const uint16_t count = be16(name, 2);
+  const uint16_t storage = be16(name, 4);
+  if (be16(name, 0) != 0 || name.size() < 6 + count * 12u) {
+    return std::string(name);
+  }
+
+  bool has_windows = false;
+  for (size_t i = 0; i < count; i++) {
+    has_windows = has_windows || be16(name, 6 + i * 12) == 3;
+  }
+
+  std::string records;
+  std::string strings;
+  std::unordered_map<std::string_view, size_t> stored;
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++) {
+    const size_t record = 6 + i * 12;
+    const uint16_t length = be16(name, record + 8);
+    const size_t offset = storage + be16(name, record + 10);
+    if ((has_windows && be16(name, record) == 1) || offset + length > name.size()) {
+      continue;
+    }
+
+    const std::string_view string = name.substr(offset, length);
+    auto [it, added] = stored.try_emplace(string, strings.size());
+    if (added) {
+      strings += string;
+    }
+    records += name.substr(record, 10);
+    put16(records, it->second);
+    kept++;
+  }
+
+  std::string out;
+  put16(out, 0);
+  put16(out, kept);
+  put16(out, 6 + kept * 12);
+  return out + records + strings;
+}
+
+} // namespace
+
+namespace faf {
+
+Subsetter::Subsetter(std::vector<codepoint_range> ranges) : ranges(std::move(ranges)) {
+  std::sort(this->ranges.begin(), this->ranges.end(),
+            [](const codepoint_range &a, const codepoint_range &b) {
+              return a.first < b.first;
+            });
+
+  // Overlapping and adjacent ranges are one
+  std::vector<codepoint_range> merged;
+  for (const auto &range : this->ranges) {
+    if (!merged.empty() && range.first <= merged.back().last + 1) {
+      merged.back().last = std::max(merged.back().last, range.last);
+    } else {
+      merged.push_back(range);
+    }
+  }
+  this->ranges = std::move(merged);
+}
+
+bool Subsetter::parse_ranges(const std::string &text,
+                             std::vector<codepoint_range> &ranges) {
+  ranges.clear();
+
+  size_t start = 0;
+  while (start <= text.size()) {
+    size_t end = text.find(',', start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    std::string_view item = std::string_view(text).substr(start, end - start);
+    start = end + 1;
+
+    while (!item.empty() && std::isspace(static_cast<unsigned char>(item.front()))) {
+      item.remove_prefix(1);
+    }
+    while (!item.empty() && std::isspace(static_cast<unsigned char>(item.back()))) {
+      item.remove_suffix(1);
+    }
+    if (item.size() > 2 && (item[0] == 'U' || item[0] == 'u') && item[1] == '+') {
+      item.remove_prefix(2);
+    }
+
+    codepoint_range range;
+    const size_t dash = item.find('-');
+    const size_t wildcard = item.find('?');
+    if (dash != std::string_view::npos) {
+      std::string_view last = item.substr(dash + 1);
+      if (last.size() > 2 && (last[0] == 'U' || last[0] == 'u') && last[1] == '+') {
+        last.remove_prefix(2);
+      }
+      if (!parse_hex(item.substr(0, dash), range.first) || !parse_hex(last, range.last)) {
+        return false;
+      }
+    } else if (wildcard != std::string_view::npos) {
+      // "4??" is U+400 to U+4FF, the question marks have to come last
+      if (item.size() > 6 ||
+          item.find_first_not_of('?', wildcard) != std::string_view::npos ||
+          (wildcard > 0 && !parse_hex(item.substr(0, wildcard), range.first))) {
+        return false;
+      }
+      const size_t bits = (item.size() - wildcard) * 4;
+      range.first = wildcard > 0 ? range.first << bits : 0;
+      range.last = range.first | ((1u << bits) - 1);
+    } else if (!parse_hex(item, range.first)) {
+      return false;
+    } else {
+      range.last = range.first;
+    }
+
+    if (range.first > range.last || range.last > 0x10FFFF) {
+      return false;
+    }
+    ranges.push_back(range);
+  }
+
+  return !ranges.empty();
+}
+
+subset_report Subsetter::subset(const std::filesystem::path &path) const {
+  Timings::Span span("subset", "download");
+  subset_report report;
+  report.path = path;
+
+  std::string font;
+  if (!Util::read_file(path, font)) {
+    report.error = "could not read the font";
+    return report;
+  }
+  report.before = report.after = font.size();
+
+  std::string out;
+  if (!subset(font, out, report.error)) {
+    return report;
+  }
+  if (out.size() >= font.size()) {
+    report.error = "the subset isn't any smaller";
+    return report;
+  }
+  if (!Util::write_file(path, out)) {
+    report.error = "could not write the subset";
+    return report;
+  }
+
+  report.after = out.size();
+  return report;
+}
+
+bool Subsetter::subset(std::string_view font, std::string &out,
+                       std::string &error) const {
+  const uint32_t version = be32(font, 0);
+  if (version == OPENTYPE_CFF) {
+    error = "CFF outlines are not supported";
+    return false;
+  }
+  if (version == COLLECTION) {
+    error = "font collections are not supported";
+    return false;
+  }
+  if (version == WOFF || version == WOFF2) {
+    error = "WOFF files are not supported";
+    return false;
+  }
+  if (version != TRUETYPE && version != APPLE_TRUETYPE) {
+    error = "not a TrueType font";
+    return false;
+  }
+
+  std::map<uint32_t, std::string_view> tables;
+  for (size_t i = 0, count = be16(font, 4); i < count; i++) {
+    const size_t record = 12 + i * 16;
+    const uint32_t offset = be32(font, record + 8);
+    const uint32_t length = be32(font, record + 12);
+    if (record + 16 > font.size() || offset > font.size() ||
+        length > font.size() - offset) {
+      error = "broken table directory";
+      return false;
+    }
+    tables[be32(font, record)] = font.substr(offset, length);
+  }
+
+  for (uint32_t tag : {CMAP, GLYF, HEAD, HHEA, HMTX, LOCA, MAXP}) {
+    if (!tables.count(tag)) {
+      error = "missing tables";
+      return false;
+    }
+  }
+  const std::string_view glyf = tables[GLYF];
+  const std::string_view head = tables[HEAD];
+  const std::string_view loca = tables[LOCA];
+  const uint16_t glyphs = be16(tables[MAXP], 4);
+  if (head.size() < 54 || glyphs == 0) {
+    error = "broken head or maxp table";
+    return false;
+  }
+
+  const bool long_loca = be16(head, 50) != 0;
+  std::vector<uint32_t> offsets(glyphs + 1);
+  for (size_t glyph = 0; glyph <= glyphs; glyph++) {
+    offsets[glyph] = long_loca ? be32(loca, glyph * 4) : be16(loca, glyph * 2) * 2u;
+    if (loca.size() < (glyph + 1) * (long_loca ? 4 : 2) || offsets[glyph] > glyf.size() ||
+        (glyph > 0 && offsets[glyph] < offsets[glyph - 1])) {
+      error = "broken loca table";
+      return false;
+    }
+  }
+
+  std::vector<cmap_entry> entries;
+  if (!read_cmap(tables[CMAP], ranges, glyphs, entries, error)) {
+    return false;
+  }
+  if (entries.empty()) {
+    error = "none of the codepoints are in the font";
+    return false;
+  }
+
+  // .notdef is drawn for everything left out
+  std::vector<bool> keep(glyphs);
+  keep[0] = true;
+  for (const auto &entry : entries) {
+    keep[entry.glyph] = true;
+  }
+  close_composites(glyf, offsets, keep);
+
+  std::map<uint32_t, std::string> rebuilt;
+
+  std::string &glyf_out = rebuilt[GLYF];
+  std::vector<uint32_t> kept(glyphs + 1);
+  for (size_t glyph = 0; glyph < glyphs; glyph++) {
+    kept[glyph] = glyf_out.size();
+    if (keep[glyph]) {
+      glyf_out += glyf.substr(offsets[glyph], offsets[glyph + 1] - offsets[glyph]);
+      pad4(glyf_out);
+    }
+  }
+  kept[glyphs] = glyf_out.size();
+
+  const bool short_loca = glyf_out.size() / 2 <= 0xFFFF;
+  std::string &loca_out = rebuilt[LOCA];
+  for (uint32_t offset : kept) {
+    if (short_loca) {
+      put16(loca_out, offset / 2);
+    } else {
+      put32(loca_out, offset);
+    }
+  }
+
+  std::string &head_out = rebuilt[HEAD];
+  head_out.assign(head);
+  set32(head_out, 8, 0);
+  set16(head_out, 50, short_loca ? 0 : 1);
+
+  if (!build_hmtx(tables[HMTX], tables[HHEA], keep, rebuilt[HMTX], rebuilt[HHEA])) {
+    error = "broken hmtx or hhea table";
+    return false;
+  }
+
+  rebuilt[CMAP] = build_cmap(entries);
+
+  if (tables.count(GVAR) && !build_gvar(tables[GVAR], keep, rebuilt[GVAR])) {
+    rebuilt.erase(GVAR);
+  }
+  if (tables.count(NAME)) {
+    rebuilt[NAME] = build_name(tables[NAME]);
+  }
+  // Version 3 has no glyph names
+  if (tables.count(POST) && tables[POST].size() >= 32) {
+    std::string &post = rebuilt[POST];
+    post.assign(tables[POST].substr(0, 32));
+    set32(post, 0, 0x00030000);
+  }
+  if (tables.count(OS2) && tables[OS2].size() >= 68) {
+    std::string &os2 = rebuilt[OS2];
+    os2.assign(tables[OS2]);
+    set16(os2, 64, std::min<uint32_t>(entries.front().codepoint, 0xFFFF));
+    set16(os2, 66, std::min<uint32_t>(entries.back().codepoint, 0xFFFF));
+  }
+
+  // The signature would no longer match
+  tables.erase(DSIG);
+
+  const size_t count = tables.size();
+  uint16_t selector = 0;
+  while ((2u << selector) <= count) {
+    selector++;
+  }
+  const uint16_t search_range = 16 << selector;
+
+  out.clear();
+  put32(out, version);
+  put16(out, count);
+  put16(out, search_range);
+  put16(out, selector);
+  put16(out, count * 16 - search_range);
+
+  std::string data;
+  size_t head_offset = 0;
+  for (const auto &[tag, original] : tables) {
+    auto it = rebuilt.find(tag);
+    const std::string_view table =
+        it != rebuilt.end() ? std::string_view(it->second) : original;
+    const size_t offset = 12 + count * 16 + data.size();
+    if (tag == HEAD) {
+      head_offset = offset;
+    }
+
+    put32(out, tag);
+    put32(out, checksum(table));
+    put32(out, offset);
+    put32(out, table.size());
+    data += table;
+    pad4(data);
+  }
+  out += data;
+
+  set32(out, head_offset + 8, CHECKSUM_MAGIC - checksum(out));
+  return true;
+}
+
+} // namespace faf
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace faf {
+
+struct codepoint_range {
+  uint32_t first;
+  uint32_t last;
+};
+
+struct subset_report {
+  std::filesystem::path path;
+  // Sizes of the file before and after, the same if it was left alone
+  uintmax_t before = 0;
+  uintmax_t after = 0;
+  // Why the file was left alone, empty if it was subset
+  std::string error;
+};
+
+// Cuts TrueType fonts down to the codepoints of a few scripts, for images that
+// don't need the rest, set with --subset.
+//
+// Glyphs keep their ids, those no kept codepoint needs, directly or as a part of
+// a composite glyph, are only emptied. Every table indexed by glyph, like GSUB,
+// GPOS or kern, therefore stays valid as it is. glyf, loca, hmtx, gvar and cmap
+// are rebuilt, post loses its glyph names and name its legacy Mac records.
+// Fonts with CFF outlines, collections and WOFF files are left alone.
+class Subsetter {
+public:
+  explicit Subsetter(std::vector<codepoint_range> ranges);
+
+  // Reads ranges the way CSS's unicode-range writes them, separated by commas:
+  // "U+0-7F,U+A0-FF,U+20AC,U+4??"
+  static bool parse_ranges(const std::string &text, std::vector<codepoint_range> &ranges);
+
+  // Replaces the font at `path` with its subset, unless it can't be subset or
+  // the subset wouldn't be smaller
+  subset_report subset(const std::filesystem::path &path) const;
+
+  // The subset of the font in `font`, false with the reason in `error` if it
+  // can't be subset
+  bool subset(std::string_view font, std::string &out, std::string &error) const;
+
+private:
+  // Sorted and merged
+  std::vector<codepoint_range> ranges;
+};
+
+} // namespace faf
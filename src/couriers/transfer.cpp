@@ -0,0 +1,172 @@
+#include "transfer.h"
+
+#include <cctype>
+
+namespace {
+
+// Set by the innermost Transfer::CancelScope of the thread
+thread_local const std::atomic<bool> *cancel_flag = nullptr;
+
+} // namespace
+
+namespace faf {
+
+Transfer::CancelScope::CancelScope(const std::atomic<bool> &cancelled)
+    : previous(cancel_flag) {
+  cancel_flag = &cancelled;
+}
+
+Transfer::CancelScope::~CancelScope() { cancel_flag = previous; }
+
+Transfer &Transfer::get() {
+  static Transfer transfer;
+  return transfer;
+}
+
+Transfer::Transfer() {
+  curl_global_init(CURL_GLOBAL_DEFAULT);
+
+  share = curl_share_init();
+  if (share) {
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, Transfer::lock);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, Transfer::unlock);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, static_cast<void *>(this));
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    // Not the connection cache: libcurl does not support sharing it between
+    // threads that transfer at the same time, as couriers and fafd clients do
+  }
+}
+
+Transfer::~Transfer() {
+  for (CURL *handle : pool) {
+    curl_easy_cleanup(handle);
+  }
+  pool.clear();
+
+  if (share) {
+    curl_share_cleanup(share);
+  }
+
+  curl_global_cleanup();
+}
+
+CURL *Transfer::acquire() {
+  CURL *handle = nullptr;
+
+  {
+    std::lock_guard<std::mutex> guard(pool_mutex);
+    if (!pool.empty()) {
+      handle = pool.back();
+      pool.pop_back();
+    }
+  }
+
+  if (!handle) {
+    handle = curl_easy_init();
+    if (!handle) {
+      return nullptr;
+    }
+  }
+
+  if (share) {
+    curl_easy_setopt(handle, CURLOPT_SHARE, share);
+  }
+  // Negotiate HTTP/2 over TLS and, inside a multi handle, wait for an existing
+  // connection to multiplex on rather than opening a new one.
+  curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+  curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+
+  // curl asks at least once a second, also while nothing arrives
+  if (cancel_flag) {
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, Transfer::xferinfo);
+    curl_easy_setopt(handle, CURLOPT_XFERINFODATA,
+                     const_cast<void *>(static_cast<const void *>(cancel_flag)));
+  }
+
+  return handle;
+}
+
+void Transfer::release(CURL *handle) {
+  if (!handle) {
+    return;
+  }
+
+  // Resetting keeps the handle's live connections and caches
+  curl_easy_reset(handle);
+
+  std::lock_guard<std::mutex> guard(pool_mutex);
+  pool.push_back(handle);
+}
+
+size_t Transfer::read_validators(char *buffer, size_t size, size_t nitems, void *userdata) {
+  http_validators *v = static_cast<http_validators *>(userdata);
+  std::string line(buffer, size * nitems);
+
+  // Each response of a redirect chain starts with its status line
+  if (line.starts_with("HTTP/")) {
+    v->etag.clear();
+    v->last_modified.clear();
+    return size * nitems;
+  }
+
+  size_t colon = line.find(':');
+  if (colon == std::string::npos) {
+    return size * nitems;
+  }
+
+  std::string key = line.substr(0, colon);
+  for (auto &c : key) {
+    c = std::tolower(static_cast<unsigned char>(c));
+  }
+
+  std::string value = line.substr(colon + 1);
+  value.erase(0, value.find_first_not_of(" \t"));
+  value.erase(value.find_last_not_of(" \t\r\n") + 1);
+
+  if (key == "etag") {
+    v->etag = value;
+  } else if (key == "last-modified") {
+    v->last_modified = value;
+  }
+
+  return size * nitems;
+}
+
+bool Transfer::is_transient(CURLcode res) {
+  switch (res) {
+  case CURLE_COULDNT_CONNECT:
+  case CURLE_PARTIAL_FILE:
+  case CURLE_SEND_ERROR:
+  case CURLE_RECV_ERROR:
+  case CURLE_OPERATION_TIMEDOUT:
+  case CURLE_GOT_NOTHING:
+  case CURLE_HTTP2:
+  case CURLE_HTTP2_STREAM:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool Transfer::is_throttled(CURLcode res, CURL *handle) {
+  long status = 0;
+  curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+  return res == CURLE_HTTP_RETURNED_ERROR && (status == 429 || status == 503);
+}
+
+int Transfer::xferinfo(void *clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+  return static_cast<const std::atomic<bool> *>(clientp)->load(std::memory_order_relaxed);
+}
+
+void Transfer::lock(CURL *, curl_lock_data data, curl_lock_access, void *userptr) {
+  static_cast<Transfer *>(userptr)->share_mutexes[data].lock();
+}
+
+void Transfer::unlock(CURL *, curl_lock_data data, void *userptr) {
+  static_cast<Transfer *>(userptr)->share_mutexes[data].unlock();
+}
+
+} // namespace faf
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace faf {
+
+// The ETag and Last-Modified of a response, collected by Transfer::read_validators
+struct http_validators {
+  std::string etag;
+  std::string last_modified;
+};
+
+// Process-wide curl state shared by every courier and download.
+//
+// Easy handles are pooled so their connections survive between requests, and all
+// of them are attached to one share object holding the DNS cache and TLS sessions.
+// Requests to the same host therefore only pay for the lookup once per run and
+// resume their TLS sessions. Connections stay with the easy handle or the multi
+// handle that opened them.
+class Transfer {
+public:
+  static Transfer &get();
+
+  Transfer(const Transfer &) = delete;
+  Transfer &operator=(const Transfer &) = delete;
+
+  // While alive, the transfers of the handles this thread acquires abort with
+  // CURLE_ABORTED_BY_CALLBACK once `cancelled` is set. Lets a thread that gave up
+  // on another one's work stop it before joining it.
+  class CancelScope {
+  public:
+    explicit CancelScope(const std::atomic<bool> &cancelled);
+    ~CancelScope();
+
+    CancelScope(const CancelScope &) = delete;
+    CancelScope &operator=(const CancelScope &) = delete;
+
+  private:
+    const std::atomic<bool> *previous;
+  };
+
+  // Returns an easy handle with the shared defaults applied, or nullptr.
+  CURL *acquire();
+  // Resets the handle's options and returns it to the pool.
+  void release(CURL *handle);
+
+  // CURLOPT_HEADERFUNCTION filling the http_validators given as CURLOPT_HEADERDATA.
+  // Only the final response of a redirect chain is kept.
+  static size_t read_validators(char *buffer, size_t size, size_t nitems, void *userdata);
+
+  // Failures where the connection broke off and asking again is worth it
+  static bool is_transient(CURLcode res);
+  // Answers of a server that wants to be asked less often, 429 and 503
+  static bool is_throttled(CURLcode res, CURL *handle);
+
+private:
+  Transfer();
+  ~Transfer();
+
+  static void lock(CURL *handle, curl_lock_data data, curl_lock_access access,
+                   void *userptr);
+  static void unlock(CURL *handle, curl_lock_data data, void *userptr);
+  static int xferinfo(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
+                      curl_off_t ultotal, curl_off_t ulnow);
+
+  CURLSH *share;
+  std::mutex share_mutexes[CURL_LOCK_DATA_LAST];
+
+  std::mutex pool_mutex;
+  std::vector<CURL *> pool;
+};
+
+} // namespace faf
@@ -0,0 +1,175 @@
+#include "transfer_loop.h"
+
+#include <algorithm>
+
+#include "rate_limit.h"
+#include "transfer.h"
+
+namespace {
+
+// Attempts per transfer
+constexpr int MAX_ATTEMPTS = 5;
+// A server asking to come back later than this is taken as refusing for now
+constexpr std::chrono::seconds MAX_RETRY_AFTER(60);
+
+} // namespace
+
+namespace faf {
+
+TransferLoop::TransferLoop(size_t jobs) : multi(curl_multi_init()), scheduler(jobs) {
+  if (multi) {
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  }
+}
+
+TransferLoop::~TransferLoop() {
+  if (multi) {
+    curl_multi_cleanup(multi);
+  }
+}
+
+bool TransferLoop::ok() const { return multi != nullptr; }
+
+void TransferLoop::add(item *t) {
+  t->loop = this;
+  t->attempts = 0;
+  transfers.push_back(t);
+  in_flight++;
+  attempt(t);
+}
+
+bool TransferLoop::take(item *t, size_t bytes) {
+  // curl hands the same data over again once the transfer is unpaused
+  if (!RateLimit::get().take(bytes)) {
+    t->paused = true;
+    return false;
+  }
+  scheduler.received(bytes);
+  return true;
+}
+
+void TransferLoop::attempt(item *t) {
+  cb.prepare(t);
+  t->attempts++;
+  t->round = scheduler.started();
+  t->paused = false;
+  curl_multi_add_handle(multi, t->handle);
+}
+
+bool TransferLoop::run(callbacks callbacks) {
+  cb = std::move(callbacks);
+  if (!multi) {
+    return false;
+  }
+
+  while (in_flight < scheduler.window() && cb.start_next()) {
+    ;
+  }
+
+  CURLMcode mc = CURLM_OK;
+  while (in_flight > 0) {
+    int still_running = 0;
+    mc = curl_multi_perform(multi, &still_running);
+
+    // Woken up early for the next retry, or when the rate limit lets paused
+    // transfers go on
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::milliseconds timeout(1000);
+    for (item *t : retrying) {
+      const auto left = std::chrono::ceil<std::chrono::milliseconds>(t->retry_at - now);
+      timeout = std::clamp(left, std::chrono::milliseconds(0), timeout);
+    }
+    const bool any_paused = std::any_of(transfers.begin(), transfers.end(),
+                                        [](item *t) { return t->handle && t->paused; });
+    if (any_paused) {
+      timeout = std::min(timeout, RateLimit::get().wait());
+    }
+
+    if (mc == CURLM_OK && (still_running || !retrying.empty())) {
+      mc = curl_multi_poll(multi, nullptr, 0, timeout.count(), nullptr);
+    }
+    if (mc != CURLM_OK) {
+      break;
+    }
+
+    now = std::chrono::steady_clock::now();
+    std::erase_if(retrying, [&](item *t) {
+      if (t->retry_at > now) {
+        return false;
+      }
+      attempt(t);
+      return true;
+    });
+
+    if (any_paused && RateLimit::get().wait().count() == 0) {
+      for (item *t : transfers) {
+        if (t->handle && t->paused) {
+          t->paused = false;
+          curl_easy_pause(t->handle, CURLPAUSE_CONT);
+        }
+      }
+    }
+
+    CURLMsg *msg;
+    int msgs_left;
+    while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+
+      item *t;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, reinterpret_cast<char **>(&t));
+
+      CURLcode res = msg->data.result;
+      curl_multi_remove_handle(multi, t->handle);
+
+      if (cb.restart && cb.restart(t, res)) {
+        attempt(t);
+        continue;
+      }
+
+      // Fewer transfers at once for a while, then this one again after a backoff
+      if (Transfer::is_throttled(res, t->handle) ||
+          (res != CURLE_OK && Transfer::is_transient(res))) {
+        scheduler.congested(t->round);
+
+        curl_off_t retry_after = 0;
+        curl_easy_getinfo(t->handle, CURLINFO_RETRY_AFTER, &retry_after);
+        if (t->attempts < MAX_ATTEMPTS && retry_after <= MAX_RETRY_AFTER.count()) {
+          t->retry_at = std::chrono::steady_clock::now() +
+                        scheduler.backoff(t->attempts, std::chrono::seconds(retry_after));
+          retrying.push_back(t);
+          continue;
+        }
+      }
+
+      if (cb.finish(t, res)) {
+        scheduler.succeeded();
+      }
+
+      Transfer::get().release(t->handle);
+      t->handle = nullptr;
+      in_flight--;
+
+      while (in_flight < scheduler.window() && cb.start_next()) {
+        ;
+      }
+    }
+  }
+
+  // Only reached with transfers in flight if the multi handle itself failed
+  for (item *t : transfers) {
+    if (t->handle) {
+      curl_multi_remove_handle(multi, t->handle);
+      cb.abort(t);
+      Transfer::get().release(t->handle);
+      t->handle = nullptr;
+    }
+  }
+  retrying.clear();
+  in_flight = 0;
+
+  return mc == CURLM_OK;
+}
+
+} // namespace faf
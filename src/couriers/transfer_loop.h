@@ -0,0 +1,85 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "scheduler.h"
+
+namespace faf {
+
+// Runs a batch of transfers on one multi handle, like the fonts of a
+// Downloader::download call or the files of a Mirror::sync.
+//
+// As many transfers are in flight as the Scheduler's window allows. Those a server
+// throttled or that broke off are retried after a backoff, and those the rate
+// limit holds back are paused until it lets them go on. What a transfer is and
+// what becomes of it is up to the callbacks.
+class TransferLoop {
+public:
+  // What the loop keeps of a transfer, the callers' transfers derive from it
+  struct item {
+    TransferLoop *loop = nullptr;
+    CURL *handle = nullptr;
+    int attempts = 0;
+    // What the scheduler told the current attempt when it started
+    size_t round = 0;
+    // Waiting for the rate limit to let it receive more
+    bool paused = false;
+    // When the next attempt of a transfer waiting to be retried starts
+    std::chrono::steady_clock::time_point retry_at;
+  };
+
+  struct callbacks {
+    // Sets up the next transfer and hands it to add(). Returns false once there
+    // is nothing left to start.
+    std::function<bool()> start_next;
+    // Readies the next attempt of a transfer, right before its handle is added
+    std::function<void(item *)> prepare;
+    // Whether a transfer that ended with `res` starts over right away, optional
+    std::function<bool(item *, CURLcode)> restart;
+    // A transfer ended for good with `res`, returns whether it succeeded. Its
+    // handle is released afterwards.
+    std::function<bool(item *, CURLcode)> finish;
+    // A transfer was still in flight when the multi handle failed. Its handle
+    // is released afterwards.
+    std::function<void(item *)> abort;
+  };
+
+  explicit TransferLoop(size_t jobs);
+  ~TransferLoop();
+
+  TransferLoop(const TransferLoop &) = delete;
+  TransferLoop &operator=(const TransferLoop &) = delete;
+
+  // Whether the multi handle could be created
+  bool ok() const;
+
+  // Runs until every transfer has ended. Returns false if the multi handle
+  // failed, which aborts the transfers in flight.
+  bool run(callbacks cb);
+
+  // Starts the first attempt of a transfer whose handle is set up
+  void add(item *t);
+
+  // For the write callbacks: whether `bytes` more of `t` may be received now,
+  // otherwise it is marked paused and CURL_WRITEFUNC_PAUSE is to be returned
+  bool take(item *t, size_t bytes);
+
+private:
+  void attempt(item *t);
+
+  CURLM *multi;
+  Scheduler scheduler;
+  callbacks cb;
+
+  size_t in_flight = 0;
+  std::vector<item *> transfers;
+  // Transfers backing off before their next attempt, they count as in flight
+  std::vector<item *> retrying;
+};
+
+} // namespace faf
@@ -0,0 +1,312 @@
+#include "zip_extractor.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+constexpr uint32_t LOCAL_HEADER = 0x04034b50;
+constexpr uint32_t CENTRAL_HEADER = 0x02014b50;
+constexpr uint32_t END_OF_CENTRAL = 0x06054b50;
+constexpr uint32_t DESCRIPTOR = 0x08074b50;
+
+// General purpose flag telling that sizes and CRC follow the data
+constexpr uint16_t HAS_DESCRIPTOR = 1 << 3;
+constexpr uint16_t ENCRYPTED = 1 << 0;
+
+constexpr uint16_t STORED = 0;
+constexpr uint16_t DEFLATED = 8;
+
+uint16_t le16(const std::string &s, size_t at) {
+  return uint8_t(s[at]) | uint16_t(uint8_t(s[at + 1])) << 8;
+}
+
+uint32_t le32(const std::string &s, size_t at) {
+  return le16(s, at) | uint32_t(le16(s, at + 2)) << 16;
+}
+
+uint64_t le64(const std::string &s, size_t at) {
+  return le32(s, at) | uint64_t(le32(s, at + 4)) << 32;
+}
+
+} // namespace
+
+namespace faf {
+
+ZipExtractor::ZipExtractor(std::filesystem::path dir) : dir(std::move(dir)) {}
+
+ZipExtractor::~ZipExtractor() { close_member(); }
+
+bool ZipExtractor::is_zip(const char *data, size_t size) {
+  return size >= 4 && std::memcmp(data, "PK\x03\x04", 4) == 0;
+}
+
+bool ZipExtractor::feed(const char *data, size_t size) {
+  while (size > 0 && state != STATE::DONE && state != STATE::FAILED) {
+    if (state == STATE::DATA) {
+      size_t used = 0;
+      if (!consume(data, size, used)) {
+        close_member();
+        state = STATE::FAILED;
+        break;
+      }
+      data += used;
+      size -= used;
+      continue;
+    }
+
+    size_t take = std::min(size, wanted - pending.size());
+    pending.append(data, take);
+    data += take;
+    size -= take;
+    if (pending.size() < wanted) {
+      break;
+    }
+
+    bool ok = state == STATE::HEADER ? parse_header()
+              : state == STATE::NAME ? parse_name()
+                                     : parse_descriptor();
+    if (!ok) {
+      close_member();
+      state = STATE::FAILED;
+    }
+  }
+
+  return state != STATE::FAILED;
+}
+
+bool ZipExtractor::finish() const { return state == STATE::DONE; }
+
+void ZipExtractor::discard() {
+  close_member();
+  std::error_code ec;
+  for (const auto &file : files) {
+    std::filesystem::remove(file, ec);
+  }
+  files.clear();
+}
+
+const std::vector<std::filesystem::path> &ZipExtractor::get_files() const { return files; }
+
+bool ZipExtractor::parse_header() {
+  const uint32_t signature = le32(pending, 0);
+
+  // The members are over once the central directory starts
+  if (signature == CENTRAL_HEADER || signature == END_OF_CENTRAL) {
+    state = STATE::DONE;
+    return true;
+  }
+  if (signature != LOCAL_HEADER) {
+    return false;
+  }
+
+  flags = le16(pending, 6);
+  method = le16(pending, 8);
+  expected_crc = le32(pending, 14);
+  remaining = le32(pending, 18);
+
+  state = STATE::NAME;
+  wanted = pending.size() + le16(pending, 26) + le16(pending, 28);
+  return true;
+}
+
+bool ZipExtractor::parse_name() {
+  const size_t name_size = le16(pending, 26);
+  const std::string name = pending.substr(30, name_size);
+
+  // A ZIP64 extra field holds the real sizes of those set to 0xffffffff in the
+  // header, the uncompressed size first, then the compressed one
+  zip64 = false;
+  for (size_t at = 30 + name_size; at + 4 <= pending.size();) {
+    const uint16_t id = le16(pending, at);
+    const uint16_t size = le16(pending, at + 2);
+    if (id == 0x0001) {
+      zip64 = true;
+      const size_t end = std::min(pending.size(), at + 4 + size);
+      size_t field = at + 4;
+      if (le32(pending, 22) == 0xffffffff) {
+        field += 8;
+      }
+      if (remaining == 0xffffffff && field + 8 <= end) {
+        remaining = le64(pending, field);
+      }
+    }
+    at += 4 + size;
+  }
+
+  if (flags & ENCRYPTED || (method != STORED && method != DEFLATED)) {
+    return false;
+  }
+  // Without the size there's no telling where stored data ends
+  if (method == STORED && flags & HAS_DESCRIPTOR) {
+    return false;
+  }
+
+  // Only the file name is used, so members can't point outside the directory
+  std::string file = std::filesystem::path(name).filename().string();
+  std::string ext = std::filesystem::path(file).extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+
+  // Members of different folders can share a name, the first one is kept
+  const bool extracted = std::find(files.begin(), files.end(), dir / file) != files.end();
+  const bool wanted_member = name.find("__MACOSX/") == std::string::npos &&
+                             !file.empty() && file[0] != '.' &&
+                             (ext == ".ttf" || ext == ".otf") && !extracted;
+  if (wanted_member) {
+    out_path = dir / file;
+    std::filesystem::path part = out_path;
+    part += ".part";
+    out = fopen(part.c_str(), "wb");
+    if (!out) {
+      return false;
+    }
+  }
+
+  crc = crc32(0L, Z_NULL, 0);
+  inflating = method == DEFLATED && (wanted_member || flags & HAS_DESCRIPTOR);
+  if (inflating) {
+    zs = {};
+    if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+      inflating = false;
+      return false;
+    }
+  }
+
+  pending.clear();
+  state = STATE::DATA;
+  // Members without any data end right away
+  if (!inflating && remaining == 0) {
+    return end_member(crc);
+  }
+  return true;
+}
+
+bool ZipExtractor::parse_descriptor() {
+  const size_t sizes = zip64 ? 16 : 8;
+
+  if (pending.size() == 4) {
+    // The signature of the descriptor is optional
+    wanted = le32(pending, 0) == DESCRIPTOR ? 8 + sizes : 4 + sizes;
+    return true;
+  }
+
+  const uint32_t descriptor_crc = le32(pending, pending.size() == 8 + sizes ? 4 : 0);
+
+  pending.clear();
+  wanted = 30;
+  state = STATE::HEADER;
+
+  if (out && descriptor_crc != crc) {
+    return false;
+  }
+  return finish_file();
+}
+
+bool ZipExtractor::consume(const char *data, size_t size, size_t &used) {
+  if (!inflating) {
+    // Stored data, or deflated data of a skipped member with a known size
+    used = std::min<uint64_t>(size, remaining);
+    if (method == STORED && !write(reinterpret_cast<const unsigned char *>(data), used)) {
+      return false;
+    }
+    remaining -= used;
+    return remaining > 0 || end_member(expected_crc);
+  }
+
+  unsigned char buffer[64 * 1024];
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  zs.avail_in = size;
+
+  int ret = Z_OK;
+  do {
+    zs.next_out = buffer;
+    zs.avail_out = sizeof(buffer);
+    ret = inflate(&zs, Z_NO_FLUSH);
+    if (ret != Z_OK && ret != Z_STREAM_END) {
+      return false;
+    }
+    if (!write(buffer, sizeof(buffer) - zs.avail_out)) {
+      return false;
+    }
+  } while (ret != Z_STREAM_END && (zs.avail_in > 0 || zs.avail_out == 0));
+
+  used = size - zs.avail_in;
+
+  if (ret == Z_STREAM_END) {
+    inflateEnd(&zs);
+    inflating = false;
+    remaining = 0;
+    return end_member(expected_crc);
+  }
+  return true;
+}
+
+bool ZipExtractor::write(const unsigned char *data, size_t size) {
+  if (!out || size == 0) {
+    return true;
+  }
+  crc = crc32(crc, data, size);
+  return fwrite(data, 1, size, out) == size;
+}
+
+bool ZipExtractor::end_member(uint32_t member_crc) {
+  if (flags & HAS_DESCRIPTOR) {
+    state = STATE::DESCRIPTOR;
+    wanted = 4;
+    return true;
+  }
+
+  state = STATE::HEADER;
+  wanted = 30;
+
+  if (out && member_crc != crc) {
+    return false;
+  }
+  return finish_file();
+}
+
+bool ZipExtractor::finish_file() {
+  if (!out) {
+    return true;
+  }
+
+  bool written = fflush(out) == 0 && fsync(fileno(out)) == 0;
+  written = fclose(out) == 0 && written;
+  out = nullptr;
+
+  std::filesystem::path part = out_path;
+  part += ".part";
+  std::error_code ec;
+  if (written) {
+    std::filesystem::rename(part, out_path, ec);
+  }
+  if (!written || ec) {
+    std::filesystem::remove(part, ec);
+    return false;
+  }
+
+  files.push_back(out_path);
+  return true;
+}
+
+void ZipExtractor::close_member() {
+  if (inflating) {
+    inflateEnd(&zs);
+    inflating = false;
+  }
+  if (out) {
+    fclose(out);
+    out = nullptr;
+
+    std::filesystem::path part = out_path;
+    part += ".part";
+    std::error_code ec;
+    std::filesystem::remove(part, ec);
+  }
+}
+
+} // namespace faf
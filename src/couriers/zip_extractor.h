@@ -0,0 +1,77 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace faf {
+
+// Unpacks the font files of a ZIP archive into a directory while the archive is
+// still arriving, reading its local headers front to back. The archive itself is
+// never stored, and everything but .ttf and .otf members is skipped, as are
+// members named like one extracted before them.
+//
+// Each font is written to `<name>.part` and renamed once its CRC checks out. The
+// central directory at the end is not needed and ignored.
+class ZipExtractor {
+public:
+  explicit ZipExtractor(std::filesystem::path dir);
+  // Removes the member being written, if any
+  ~ZipExtractor();
+
+  ZipExtractor(const ZipExtractor &) = delete;
+  ZipExtractor &operator=(const ZipExtractor &) = delete;
+
+  // Takes the next bytes of the archive, false if it is broken or unsupported
+  bool feed(const char *data, size_t size);
+  // Whether the archive was read up to its central directory
+  bool finish() const;
+  // Removes the fonts extracted so far
+  void discard();
+
+  const std::vector<std::filesystem::path> &get_files() const;
+
+  // Whether `data` starts like a ZIP archive
+  static bool is_zip(const char *data, size_t size);
+
+private:
+  enum class STATE { HEADER, NAME, DATA, DESCRIPTOR, DONE, FAILED };
+
+  bool parse_header();
+  bool parse_name();
+  bool parse_descriptor();
+  bool consume(const char *data, size_t size, size_t &used);
+  bool write(const unsigned char *data, size_t size);
+  bool end_member(uint32_t member_crc);
+  // Publishes the font written for the member just read, if any
+  bool finish_file();
+  // Drops the member being read, removing its unfinished font
+  void close_member();
+
+  std::filesystem::path dir;
+  std::vector<std::filesystem::path> files;
+
+  STATE state = STATE::HEADER;
+  // Bytes collected for the header, name or descriptor being read
+  std::string pending;
+  size_t wanted = 30;
+
+  // Member being read
+  uint16_t flags = 0;
+  uint16_t method = 0;
+  uint32_t expected_crc = 0;
+  uint64_t remaining = 0;
+  bool zip64 = false;
+  bool inflating = false;
+  z_stream zs{};
+  uint32_t crc = 0;
+  FILE *out = nullptr;
+  std::filesystem::path out_path;
+};
+
+} // namespace faf
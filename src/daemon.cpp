@@ -0,0 +1,517 @@
+#include "daemon.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "external/nlohmann/json.hpp"
+#include "timings.h"
+#include "util.h"
+
+namespace {
+using json = nlohmann::json;
+
+// Requests are a handful of names or fonts, anything longer is not from faf
+constexpr size_t MAX_LINE = 16 * 1024 * 1024;
+
+// How often the catalogs are brought up to date, as often as a CatalogSet asks
+// the cache whether they are still fresh
+constexpr std::chrono::seconds REFRESH_INTERVAL(60);
+
+json font_to_json(const faf::font_props &font) {
+  return {{"name", font.name},
+          {"prop", font.prop},
+          {"format", font.file_format},
+          {"url", font.url},
+          {"weight", font.weight},
+          {"source", font.source},
+          {"min_weight", font.min_weight},
+          {"max_weight", font.max_weight},
+          {"version", font.version},
+          {"last_modified", font.last_modified},
+          {"sha256", font.sha256},
+          {"immutable", font.immutable}};
+}
+
+faf::font_props font_from_json(const json &font, faf::StringArena &arena) {
+  auto get = [&font, &arena](const char *key) {
+    return arena.store(font.value(key, ""));
+  };
+
+  return (faf::font_props){.name = get("name"),
+                           .prop = get("prop"),
+                           .file_format = get("format"),
+                           .url = get("url"),
+                           .weight = get("weight"),
+                           .source = get("source"),
+                           .min_weight = font.value("min_weight", 0),
+                           .max_weight = font.value("max_weight", 0),
+                           .version = get("version"),
+                           .last_modified = get("last_modified"),
+                           .sha256 = get("sha256"),
+                           .immutable = font.value("immutable", false)};
+}
+
+json results_to_json(const std::vector<std::vector<faf::font_props>> &results) {
+  json out = json::array();
+  for (const auto &fonts : results) {
+    json list = json::array();
+    for (const auto &font : fonts) {
+      list.push_back(font_to_json(font));
+    }
+    out.push_back(std::move(list));
+  }
+  return out;
+}
+
+bool results_from_json(const json &in, std::vector<std::vector<faf::font_props>> &results,
+                       faf::StringArena &arena) {
+  if (!in.is_array()) {
+    return false;
+  }
+  for (const auto &list : in) {
+    if (!list.is_array()) {
+      return false;
+    }
+    auto &fonts = results.emplace_back();
+    for (const auto &font : list) {
+      if (!font.is_object()) {
+        return false;
+      }
+      fonts.push_back(font_from_json(font, arena));
+    }
+  }
+  return true;
+}
+
+// Reads up to the next '\n', keeping whatever came after it in `buffer`
+bool read_line(int fd, std::string &buffer, std::string &line) {
+  size_t end;
+  while ((end = buffer.find('\n')) == std::string::npos) {
+    if (buffer.size() > MAX_LINE) {
+      return false;
+    }
+
+    char chunk[64 * 1024];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    buffer.append(chunk, n);
+  }
+
+  line = buffer.substr(0, end);
+  buffer.erase(0, end + 1);
+  return true;
+}
+
+bool write_all(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+bool make_address(const std::filesystem::path &path, sockaddr_un &addr) {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.native().size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.native().size());
+  return true;
+}
+
+} // namespace
+
+namespace faf {
+
+std::filesystem::path Daemon::socket_path() {
+  const char *runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+  if (runtime_dir && *runtime_dir) {
+    return std::filesystem::path(runtime_dir) / "faf" / "fafd.sock";
+  }
+  return Util::get_cache_dir() / "fafd.sock";
+}
+
+Daemon::Daemon(size_t jobs) : jobs(jobs) { registry.add_configured(); }
+
+void Daemon::preload() {
+  Timings::Span span("preload", "setup");
+  registry.preload();
+}
+
+bool Daemon::serve(const std::filesystem::path &path) {
+  sockaddr_un addr;
+  if (!make_address(path, addr)) {
+    std::cerr << "Error: socket path is too long: " << path.string() << std::endl;
+    return false;
+  }
+
+  // A socket left behind by a daemon that died is taken over, a live one isn't
+  DaemonClient probe;
+  if (probe.connect(path)) {
+    std::cerr << "Error: fafd is already running on " << path.string() << std::endl;
+    return false;
+  }
+
+  std::error_code ec;
+  if (std::filesystem::create_directories(path.parent_path(), ec)) {
+    std::filesystem::permissions(path.parent_path(), std::filesystem::perms::owner_all, ec);
+  }
+  unlink(path.c_str());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      chmod(path.c_str(), 0600) != 0 || listen(fd, 64) != 0) {
+    std::cerr << "Error: could not listen on " << path.string() << " ("
+              << std::strerror(errno) << ")" << std::endl;
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+
+  std::cout << "fafd listening on " << path.string() << std::endl;
+
+  // Brings the catalogs up to date in the background, so exact searches, which
+  // would otherwise fetch single families, keep finding them warm
+  std::thread refresher([this]() {
+    auto next = std::chrono::steady_clock::now() + REFRESH_INTERVAL;
+    while (!stopping.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(500));
+      if (std::chrono::steady_clock::now() >= next) {
+        registry.preload();
+        next = std::chrono::steady_clock::now() + REFRESH_INTERVAL;
+      }
+    }
+  });
+
+  while (!stopping.load()) {
+    // Wakes up now and then to notice stop()
+    pollfd listener = {fd, POLLIN, 0};
+    if (poll(&listener, 1, 500) <= 0) {
+      continue;
+    }
+
+    join_clients(false);
+    int client = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+      continue;
+    }
+    std::lock_guard<std::mutex> guard(clients_mutex);
+    std::thread thread(&Daemon::handle, this, client);
+    const std::thread::id id = thread.get_id();
+    clients.emplace(id, (Daemon::client){.thread = std::move(thread), .fd = client});
+  }
+
+  join_clients(true);
+  refresher.join();
+  close(fd);
+  unlink(path.c_str());
+  return true;
+}
+
+void Daemon::stop() { stopping.store(true); }
+
+void Daemon::handle(int fd) {
+  std::string buffer;
+  std::string line;
+
+  // A client may send any number of requests, one after the other
+  while (!stopping.load() && read_line(fd, buffer, line)) {
+    // A member of the wrong type throws, which must not take the daemon down
+    std::string answer;
+    try {
+      answer = reply(line);
+    } catch (const json::exception &) {
+      answer = json({{"error", "malformed request"}}).dump();
+    }
+    if (!write_all(fd, answer + "\n")) {
+      break;
+    }
+  }
+
+  // Closed under the lock, so join_clients() never shuts down a reused descriptor
+  std::lock_guard<std::mutex> guard(clients_mutex);
+  close(fd);
+  clients.at(std::this_thread::get_id()).fd = -1;
+  finished.push_back(std::this_thread::get_id());
+}
+
+void Daemon::join_clients(bool all) {
+  std::vector<std::thread> done;
+  {
+    std::lock_guard<std::mutex> guard(clients_mutex);
+    if (all) {
+      // Clients waiting for their next request are let go, ones being served
+      // get their reply first
+      for (auto &[id, client] : clients) {
+        if (client.fd >= 0) {
+          shutdown(client.fd, SHUT_RD);
+        }
+      }
+      for (auto &[id, client] : clients) {
+        done.push_back(std::move(client.thread));
+      }
+      clients.clear();
+    } else {
+      for (const auto &id : finished) {
+        auto it = clients.find(id);
+        done.push_back(std::move(it->second.thread));
+        clients.erase(it);
+      }
+    }
+    finished.clear();
+  }
+
+  for (auto &thread : done) {
+    thread.join();
+  }
+}
+
+std::string Daemon::reply(const std::string &request) {
+  json req = json::parse(request, nullptr, false);
+  if (req.is_discarded() || !req.is_object()) {
+    return json({{"error", "malformed request"}}).dump();
+  }
+
+  if (req.contains("search") && req["search"].is_array()) {
+    std::vector<std::string> query;
+    for (const auto &item : req["search"]) {
+      if (item.is_string()) {
+        query.push_back(item);
+      }
+    }
+
+    std::vector<std::string> sources;
+    if (req.contains("sources") && req["sources"].is_array()) {
+      for (const auto &name : req["sources"]) {
+        if (name.is_string()) {
+          sources.push_back(name);
+        }
+      }
+    }
+
+    const search_options options = {.exact = req.value("exact", false),
+                                     .contains = req.value("contains", false),
+                                     .variable = req.value("variable", false)};
+
+    // The results point into catalogs a concurrent search may be replacing
+    CatalogSet::Reader reader;
+    json out = json::object();
+    for (const auto &[name, results] : search(query, options, sources)) {
+      out[name] = results_to_json(results);
+    }
+    return json({{"results", out}}).dump();
+  }
+
+  if (req.contains("install") && req["install"].is_array()) {
+    StringArena arena;
+    std::vector<font_props> fonts;
+    for (const auto &font : req["install"]) {
+      if (font.is_object()) {
+        fonts.push_back(font_from_json(font, arena));
+      }
+    }
+
+    const size_t request_jobs = std::min(req.value("jobs", jobs), Downloader::MAX_JOBS);
+    json out = json::array();
+    for (const auto &result : install(fonts, request_jobs > 0 ? request_jobs : jobs)) {
+      out.push_back({{"ok", result.ok}, {"error", result.error}, {"sha256", result.sha256}});
+    }
+    return json({{"results", out}}).dump();
+  }
+
+  return json({{"error", "unknown request"}}).dump();
+}
+
+search_results Daemon::search(std::span<const std::string> query,
+                              const search_options &options,
+                              std::span<const std::string> sources) {
+  Timings::Span span("daemon search", "search");
+  // Nothing asked for is nothing searched, not every source
+  if (sources.empty()) {
+    return {};
+  }
+  return registry.search(query, options, sources);
+}
+
+std::vector<download_result> Daemon::install(const std::vector<font_props> &fonts,
+                                             size_t jobs) {
+  std::vector<std::shared_future<download_result>> pending(fonts.size());
+  std::vector<font_props> mine;
+  std::vector<std::promise<download_result>> promises;
+
+  {
+    std::lock_guard<std::mutex> guard(flight_mutex);
+    for (size_t i = 0; i < fonts.size(); i++) {
+      const std::string url(fonts[i].url);
+      auto it = in_flight.find(url);
+      if (it != in_flight.end()) {
+        pending[i] = it->second;
+        continue;
+      }
+
+      pending[i] = promises.emplace_back().get_future().share();
+      in_flight.emplace(url, pending[i]);
+      mine.push_back(fonts[i]);
+    }
+  }
+
+  // Whatever happens, the clients waiting for these files get an answer
+  std::vector<download_result> results;
+  std::string error = "not downloaded";
+  if (!mine.empty()) {
+    try {
+      Downloader downloader(false, jobs);
+      results = downloader.download(mine);
+    } catch (const std::exception &e) {
+      results.clear();
+      error = e.what();
+    }
+  }
+
+  {
+    const download_result missing{.ok = false, .error = error, .sha256 = "", .subsets = {}};
+    std::lock_guard<std::mutex> guard(flight_mutex);
+    for (size_t i = 0; i < mine.size(); i++) {
+      promises[i].set_value(i < results.size() ? results[i] : missing);
+      in_flight.erase(std::string(mine[i].url));
+    }
+  }
+
+  results.clear();
+  for (auto &result : pending) {
+    results.push_back(result.get());
+  }
+  return results;
+}
+
+DaemonClient::~DaemonClient() { disconnect(); }
+
+bool DaemonClient::connect(const std::filesystem::path &path) {
+  disconnect();
+
+  sockaddr_un addr;
+  if (!make_address(path, addr)) {
+    return false;
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    disconnect();
+    return false;
+  }
+  return true;
+}
+
+bool DaemonClient::is_connected() const { return fd >= 0; }
+
+void DaemonClient::disconnect() {
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  buffer.clear();
+}
+
+bool DaemonClient::request(const std::string &line, std::string &reply) {
+  if (fd < 0) {
+    return false;
+  }
+  if (!write_all(fd, line + "\n") || !read_line(fd, buffer, reply)) {
+    disconnect();
+    return false;
+  }
+  return true;
+}
+
+bool DaemonClient::search(std::span<const std::string> query, const search_options &options,
+                          std::span<const std::string> sources, search_results &results) {
+  Timings::Span span("daemon search", "search");
+
+  const json req = {{"search", json(std::vector<std::string>(query.begin(), query.end()))},
+                    {"exact", options.exact},
+                    {"contains", options.contains},
+                    {"variable", options.variable},
+                    {"sources",
+                     std::vector<std::string>(sources.begin(), sources.end())}};
+
+  std::string line;
+  if (!request(req.dump(), line)) {
+    return false;
+  }
+
+  json res = json::parse(line, nullptr, false);
+  if (res.is_discarded() || !res.is_object() || !res.contains("results") ||
+      !res["results"].is_object()) {
+    return false;
+  }
+
+  // A daemon started with another config may not know every source asked for
+  results = {};
+  for (const auto &name : sources) {
+    if (!res["results"].contains(name) ||
+        !results_from_json(res["results"][name], results[name], arena)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DaemonClient::install(const std::vector<font_props> &fonts, size_t jobs,
+                           std::vector<download_result> &results) {
+  Timings::Span span("daemon install", "download");
+
+  json list = json::array();
+  for (const auto &font : fonts) {
+    list.push_back(font_to_json(font));
+  }
+
+  std::string line;
+  if (!request(json({{"install", list}, {"jobs", jobs}}).dump(), line)) {
+    return false;
+  }
+
+  json res = json::parse(line, nullptr, false);
+  if (res.is_discarded() || !res.is_object() || !res.contains("results") ||
+      !res["results"].is_array() || res["results"].size() != fonts.size()) {
+    return false;
+  }
+
+  results.clear();
+  for (const auto &result : res["results"]) {
+    results.push_back({.ok = result.value("ok", false),
+                       .error = result.value("error", ""),
+                       .sha256 = result.value("sha256", ""),
+                       .subsets = {}});
+  }
+  return true;
+}
+
+} // namespace faf
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "couriers/common.h"
+#include "couriers/courier.h"
+#include "couriers/downloader.h"
+#include "couriers/registry.h"
+#include "string_arena.h"
+
+namespace faf {
+
+// fafd keeps the couriers, their catalogs and the connection pool of one user
+// resident and serves faf over a Unix socket. Each request and its reply is a
+// single line of JSON:
+//
+//   {"search": [queries], "exact": b, "contains": b, "variable": b, "sources": [s...]}
+//     -> {"results": {"<source>": [[font]...]...}}
+//   {"install": [font...], "jobs": n}
+//     -> {"results": [{"ok": b, "error": s, "sha256": s}...]}
+//
+// A file requested again while it is being installed for another client isn't
+// downloaded twice, the second request waits for the first transfer instead.
+class Daemon {
+public:
+  // Where the socket is, $XDG_RUNTIME_DIR/faf/fafd.sock or in the cache directory
+  static std::filesystem::path socket_path();
+
+  explicit Daemon(size_t jobs);
+
+  // Opens the catalogs up front, so the first search is as fast as the rest
+  void preload();
+
+  // Accepts clients on `path` until stop() is called. Returns false if the socket
+  // can't be set up or another daemon is listening on it already.
+  bool serve(const std::filesystem::path &path);
+  // Safe to call from a signal handler
+  void stop();
+
+private:
+  void handle(int fd);
+  // Joins the client threads that are done, or with `all` every one of them
+  void join_clients(bool all);
+  std::string reply(const std::string &request);
+
+  search_results search(std::span<const std::string> query, const search_options &options,
+                        std::span<const std::string> sources);
+  std::vector<download_result> install(const std::vector<font_props> &fonts, size_t jobs);
+
+  size_t jobs;
+  std::atomic<bool> stopping{false};
+
+  // Searches of several clients run at once, each on couriers of its own
+  Registry registry;
+
+  // Threads serving a client, by thread, with the client's socket
+  struct client {
+    std::thread thread;
+    int fd;
+  };
+  std::mutex clients_mutex;
+  std::unordered_map<std::thread::id, client> clients;
+  std::vector<std::thread::id> finished;
+
+  // Installs in progress by URL
+  std::mutex flight_mutex;
+  std::unordered_map<std::string, std::shared_future<download_result>> in_flight;
+};
+
+// faf's side of the socket. Every call returns false if the daemon can't be
+// reached, so the caller can do the work itself instead.
+class DaemonClient {
+public:
+  DaemonClient() = default;
+  ~DaemonClient();
+
+  DaemonClient(const DaemonClient &) = delete;
+  DaemonClient &operator=(const DaemonClient &) = delete;
+
+  bool connect(const std::filesystem::path &path = Daemon::socket_path());
+  bool is_connected() const;
+
+  // Searches `sources` of the daemon's sources. The results point into this client.
+  bool search(std::span<const std::string> query, const search_options &options,
+              std::span<const std::string> sources, search_results &results);
+  bool install(const std::vector<font_props> &fonts, size_t jobs,
+               std::vector<download_result> &results);
+
+private:
+  bool request(const std::string &line, std::string &reply);
+  void disconnect();
+
+  int fd = -1;
+  std::string buffer;
+  StringArena arena;
+};
+
+} // namespace faf
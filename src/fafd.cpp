@@ -0,0 +1,92 @@
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "couriers/catalog_cache.h"
+#include "couriers/downloader.h"
+#include "couriers/rate_limit.h"
+#include "daemon.h"
+#include "external/nlohmann/json.hpp"
+#include "util.h"
+
+namespace {
+using json = nlohmann::json;
+
+faf::Daemon *running = nullptr;
+
+void on_signal(int) {
+  if (running) {
+    running->stop();
+  }
+}
+
+void print_usage() {
+  std::cout << "Usage:\n"
+            << "    fafd <options>\n\n"
+            << "Keeps the font catalogs open and serves faf over a Unix socket.\n\n"
+            << "options:\n"
+            << "    -h                               Show this help\n"
+            << "    --socket <path>                  Listen on path instead of the default\n"
+            << "    --jobs <n>                       Download up to n files at once (default 8)\n"
+            << "    --limit-rate <rate>              Download at most rate bytes/s, like 500K or 2M"
+            << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::filesystem::path socket_path = faf::Daemon::socket_path();
+  size_t jobs = 8;
+
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "-h") {
+      print_usage();
+      return 0;
+    } else if (arg == "--socket" && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (arg == "--jobs" && i + 1 < argc) {
+      if (!faf::Downloader::parse_jobs(argv[++i], jobs)) {
+        std::cout << "Error: --jobs supplied without a valid argument\n"
+                  << "Valid arguments are numbers from 1 to "
+                  << faf::Downloader::MAX_JOBS << std::endl;
+        exit(15);
+      }
+    } else if (arg == "--limit-rate" && i + 1 < argc) {
+      size_t limit_rate = 0;
+      if (!faf::RateLimit::parse(argv[++i], limit_rate)) {
+        std::cout << "Error: --limit-rate supplied without a valid argument\n"
+                  << "Valid arguments are bytes per second, like 500K or 2M" << std::endl;
+        exit(15);
+      }
+      faf::RateLimit::get().set(limit_rate);
+    } else {
+      std::cout << "Error: unknown option '" << arg << "' (use -h for help)" << std::endl;
+      exit(16);
+    }
+  }
+
+  long cache_ttl = 24 * 60 * 60;
+  std::ifstream ifs(faf::Util::get_home_dir() + "/.config/faf/config.json");
+  json cfg = json::parse(ifs, nullptr, false);
+  if (!cfg.is_discarded() && cfg.contains("cache") && cfg["cache"].contains("ttl") &&
+      cfg["cache"]["ttl"].is_number()) {
+    cache_ttl = cfg["cache"]["ttl"];
+  }
+  faf::CatalogCache::configure(cache_ttl, faf::CACHE_POLICY::DEFAULT);
+
+  faf::Daemon daemon(jobs);
+  daemon.preload();
+
+  running = &daemon;
+  struct sigaction action = {};
+  action.sa_handler = on_signal;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  return daemon.serve(socket_path) ? 0 : 1;
+}
@@ -3,21 +3,34 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstdio>
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "couriers/catalog_cache.h"
 #include "couriers/common.h"
-#include "couriers/fontsquirrel.h"
+#include "couriers/downloader.h"
 #include "couriers/google.h"
+#include "couriers/lockfile.h"
+#include "couriers/manifest.h"
+#include "couriers/mirror.h"
+#include "couriers/rate_limit.h"
+#include "couriers/registry.h"
+#include "couriers/subsetter.h"
+#include "daemon.h"
+#include "progress.h"
+#include "timings.h"
 #include "util.h"
 
 #include "external/nlohmann/json.hpp"
 
-enum class MODE { DOWNLOAD, REMOVE, SEARCH, NONE };
+enum class MODE { DOWNLOAD, REMOVE, SEARCH, LIST, UPDATE, MIRROR, NONE };
 
 void print_usage() {
   std::cout << "Usage:\n"
@@ -26,10 +39,28 @@ void print_usage() {
             << "    faf -S [fonts]                   Download font(s)\n"
             << "    faf -R [fonts]                   Remove installed font(s)\n"
             << "    faf -Q [fonts]                   Search for font(s)\n"
+            << "    faf -L [fonts]                   List installed font(s)\n"
+            << "    faf -U [fonts]                   Update installed font(s)\n"
+            << "    faf --mirror <dir> [fonts]       Mirror the catalogs and font(s) to dir\n"
             << "\noptions:\n"
             << "    -h                               Show this help\n"
             << "    -ng --no-google                  Do not use Google Fonts\n"
             << "    --system                         Install fonts for all users\n"
+            << "    --prefer <source>                Prefer fonts from a source, like google\n"
+            << "    --jobs <n>                       Download up to n files at once (default 8)\n"
+            << "    --limit-rate <rate>              Download at most rate bytes/s, like 500K or 2M\n"
+            << "    --subset <ranges>                Only install the glyphs of unicode ranges\n"
+            << "    --refresh                        Revalidate cached font catalogs\n"
+            << "    --offline                        Only use cached font catalogs\n"
+            << "    --rebuild-index                  Recompile the cached font catalogs\n"
+            << "    --exact                          Only match whole font names\n"
+            << "    --contains                       Match fonts containing the name anywhere\n"
+            << "    --variable                       Download variable fonts when available\n"
+            << "    --from <file>                    Read fonts from a list or a lockfile\n"
+            << "    --lock <file>                    Pin the downloaded fonts in a lockfile\n"
+            << "    --no-daemon                      Do not use a running fafd\n"
+            << "    --timings                        Show where the time was spent\n"
+            << "    --trace <file>                   Write a Chrome trace of the run\n"
             << "    --ignore <variant>(,variant)     Ignore a font variant (google only)\n"
             << "    --attend <weight>(,<weight>)     Download \"extra\" font weights (google only)\n"
             << "\n"
@@ -49,7 +80,183 @@ void print_usage() {
 
 using json = nlohmann::json;
 
+// Searches every enabled source at once and merges what they found for each
+// query, taking every family from the first source that has it. A running fafd
+// is asked instead, if there is one.
+std::vector<faf::font_props> search_all(faf::Registry &registry,
+                                        faf::DaemonClient &daemon,
+                                        const std::vector<std::string> &items,
+                                        const faf::search_options &options) {
+  faf::Timings::Span span("search", "search");
+
+  faf::Progress progress("Searching...");
+
+  const std::vector<std::string> order = registry.enabled();
+  faf::search_results results;
+  if (!daemon.is_connected() || !daemon.search(items, options, order, results)) {
+    results = registry.search(items, options);
+  }
+
+  progress.stop("Search completed");
+
+  const faf::source_results merged = faf::Registry::merge(results, order, items.size());
+  std::vector<faf::font_props> res;
+
+  for (size_t q = 0; q < items.size(); q++) {
+    res.insert(res.end(), merged[q].begin(), merged[q].end());
+
+    if (merged[q].empty()) {
+      std::cout << "\033[91mError: could not find font with the name '" << items[q]
+                << "'\n\033[0m";
+    }
+  }
+
+  return res;
+}
+
+// Has fafd install the fonts, which shares the transfers with its other clients
+bool install_remote(faf::DaemonClient &daemon, const std::vector<faf::font_props> &fonts,
+                    size_t jobs, std::vector<faf::download_result> &results) {
+  faf::Progress progress("Installing...");
+  const bool ok = daemon.install(fonts, jobs, results);
+  progress.stop(ok ? "Installed by fafd" : "");
+  return ok;
+}
+
+std::string format_kib(uintmax_t bytes) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.1f KiB", bytes / 1024.0);
+  return buf;
+}
+
+// Tells what subsetting saved on each file, and why files were left whole
+void print_subsets(const std::vector<faf::download_result> &results) {
+  uintmax_t saved = 0;
+  size_t subset = 0;
+  for (const auto &result : results) {
+    for (const auto &report : result.subsets) {
+      const std::string file = report.path.filename().string();
+      if (!report.error.empty()) {
+        std::cout << "\033[93mWarning: did not subset " << file << " (" << report.error
+                  << ")\033[0m" << std::endl;
+        continue;
+      }
+      std::cout << "Subset " << file << ": " << format_kib(report.before) << " -> "
+                << format_kib(report.after) << ", saved "
+                << format_kib(report.before - report.after) << std::endl;
+      saved += report.before - report.after;
+      subset++;
+    }
+  }
+  if (subset > 1) {
+    std::cout << "Subsetting saved " << format_kib(saved) << " in total" << std::endl;
+  }
+}
+
+// Re-downloads the installed Google fonts whose release in the catalog differs from
+// the installed one, so checking every family costs a single catalog revalidation.
+// FontSquirrel's catalog has no release information, its fonts are left alone.
+void update_installed(faf::Google &gfonts, const std::vector<std::string> &items,
+                      bool system_wide, size_t jobs,
+                      const std::vector<faf::codepoint_range> &subset) {
+  faf::Manifest manifest(system_wide);
+
+  // Families installed as static and as variable fonts are looked up separately
+  std::vector<std::string> families[2];
+  size_t skipped = 0;
+
+  for (const auto &[family, files] : manifest.get_families()) {
+    if (!items.empty() &&
+        std::none_of(items.begin(), items.end(), [&family](const std::string &item) {
+          return faf::Manifest::family_name(item) == family;
+        })) {
+      continue;
+    }
+    if (files.front().source != "google") {
+      skipped++;
+      continue;
+    }
+
+    bool variable = std::any_of(files.begin(), files.end(), [](const auto &entry) {
+      return !entry.weight.empty() && std::isdigit(static_cast<unsigned char>(entry.weight[0]));
+    });
+    families[variable].push_back(family);
+  }
+
+  for (const auto &item : items) {
+    if (manifest.get_family(item).empty()) {
+      std::cout << "\033[91mError: font is not installed: '" << item << "'\n\033[0m";
+    }
+  }
+
+  std::vector<faf::font_props> selected;
+
+  for (int variable = 0; variable < 2; variable++) {
+    if (families[variable].empty()) {
+      continue;
+    }
+
+    gfonts.set_exact(true);
+    gfonts.set_variable(variable);
+    auto res = gfonts.search(families[variable]);
+
+    for (size_t q = 0; q < families[variable].size(); q++) {
+      for (const auto &entry : manifest.get_family(families[variable][q])) {
+        auto font = std::find_if(res[q].begin(), res[q].end(), [&](const faf::font_props &f) {
+          return f.prop == entry.variant && (variable || f.weight == entry.weight);
+        });
+        // Gone from the catalog, the installed file is all there is
+        if (font == res[q].end()) {
+          continue;
+        }
+
+        // Google's file URLs change with every release, and fonts installed
+        // before faf recorded versions have nothing else to compare
+        if (font->url != entry.url ||
+            (!entry.version.empty() && (font->version != entry.version ||
+                                        font->last_modified != entry.last_modified))) {
+          selected.push_back(*font);
+        }
+      }
+    }
+  }
+
+  if (skipped > 0) {
+    std::cout << "\033[93mSkipped " << skipped
+              << " font families without version information\033[0m" << std::endl;
+  }
+  if (selected.empty()) {
+    std::cout << "All fonts are up to date" << std::endl;
+    return;
+  }
+
+  faf::Downloader downloader(system_wide, jobs);
+  downloader.set_subset(subset);
+  auto results = downloader.download(selected);
+  print_subsets(results);
+
+  int dl = 0;
+  for (size_t i = 0; i < selected.size(); i++) {
+    if (!results[i].ok) {
+      std::cout << "\033[91mError: could not update font: '" << selected[i].name << "' ("
+                << results[i].error << ")\n\033[0m";
+    } else {
+      dl++;
+    }
+  }
+  std::cout << "Updated " << dl << " fonts" << std::endl;
+}
+
 int main(int argc, char *argv[]) {
+  // Looked for up front, the config is loaded before the options are read
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--timings" || arg == "--trace") {
+      faf::Timings::enable();
+    }
+  }
+
+  const auto config_start = faf::timing_clock::now();
   std::string homedir = faf::Util::get_home_dir();
 
   const std::filesystem::path faf_cfg_dir(homedir + "/.config/faf");
@@ -67,6 +274,10 @@ int main(int argc, char *argv[]) {
            "  \"google\": {\n"
            "    \"enabled\": true,\n"
            "    \"api_key\": \"\"\n"
+           "  },\n"
+           "  \"priority\": [\"google\", \"fontsquirrel\"],\n"
+           "  \"cache\": {\n"
+           "    \"ttl\": 86400\n"
            "  }\n"
            "}\n";
     ofs.close();
@@ -75,27 +286,53 @@ int main(int argc, char *argv[]) {
     ifs >> cfg;
     ifs.close();
   }
+  faf::Timings::record("config load", "setup", config_start);
 
   int mode_supplied = 0;
   MODE cur_mode = MODE::NONE;
 
   std::vector<std::string> items;
 
-  // TODO: if (config.google.enabled)
-  faf::Google gfonts;
-  faf::FontSquirrel fontsquirrel;
+  faf::Registry registry;
+  registry.add_configured();
 
   bool system_wide = false;
-  bool no_google = false;
   bool ignore_italic = false;
   bool ignore_regular = false;
   bool ignore_bold = false;
-
-  if (!cfg["google"]["enabled"]) {
-    no_google = true;
+  size_t jobs = 8;
+  size_t limit_rate = 0;
+  std::vector<faf::codepoint_range> subset;
+  long cache_ttl = 24 * 60 * 60;
+  faf::CACHE_POLICY cache_policy = faf::CACHE_POLICY::DEFAULT;
+  bool rebuild_index = false;
+  bool use_daemon = true;
+  faf::search_options search_options;
+
+  if (cfg.contains("cache") && cfg["cache"].contains("ttl") &&
+      cfg["cache"]["ttl"].is_number()) {
+    cache_ttl = cfg["cache"]["ttl"];
   }
 
   std::vector<std::string> extra_weights;
+  // Fonts pinned by a lockfile, installed without searching
+  faf::StringArena pinned_strings;
+  std::vector<faf::font_props> pinned;
+  std::string lock_path;
+  std::string mirror_dir;
+  bool show_timings = false;
+  std::string trace_path;
+
+  auto add_item = [&items](std::string arg) {
+    std::transform(arg.begin(), arg.end(), arg.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    for (size_t i = 0; i < arg.size(); i++) {
+      if (arg[i] == '-') {
+        arg[i] = ' ';
+      }
+    }
+    items.push_back(arg);
+  };
 
   for (int i = 1; i < argc; i++) {
     if (std::string(argv[i]).compare("-S") == 0) {
@@ -107,6 +344,22 @@ int main(int argc, char *argv[]) {
     } else if (std::string(argv[i]).compare("-Q") == 0) {
       cur_mode = MODE::SEARCH;
       mode_supplied++;
+    } else if (std::string(argv[i]).compare("-L") == 0) {
+      cur_mode = MODE::LIST;
+      mode_supplied++;
+    } else if (std::string(argv[i]).compare("-U") == 0) {
+      cur_mode = MODE::UPDATE;
+      mode_supplied++;
+    } else if (std::string(argv[i]).compare("--mirror") == 0) {
+      if (i + 1 < argc) {
+        mirror_dir = argv[i + 1];
+      } else {
+        std::cout << "Error: --mirror supplied without an argument" << std::endl;
+        exit(16);
+      }
+      cur_mode = MODE::MIRROR;
+      mode_supplied++;
+      i++;
     } else if (std::string(argv[i]).compare("-h") == 0) {
       print_usage();
       return 0;
@@ -123,9 +376,9 @@ int main(int argc, char *argv[]) {
       }
     } else if (std::string(argv[i]).compare("--no-google") == 0 ||
                std::string(argv[i]).compare("-ng") == 0) {
-      no_google = true;
+      registry.set_enabled("google", false);
     } else if (std::string(argv[i]).compare("--ignore") == 0) {
-      if (std::vector<std::string>(argv + 1, argv + argc).size() > i) {
+      if (i + 1 < argc) {
         size_t pos = 0;
         std::vector<std::string> ignores;
 
@@ -157,8 +410,79 @@ int main(int argc, char *argv[]) {
         std::cout << "Error: --ignore supplied without an argument" << std::endl;
         exit(16);
       }
+    } else if (std::string(argv[i]).compare("--refresh") == 0) {
+      cache_policy = faf::CACHE_POLICY::REFRESH;
+    } else if (std::string(argv[i]).compare("--offline") == 0) {
+      cache_policy = faf::CACHE_POLICY::OFFLINE;
+    } else if (std::string(argv[i]).compare("--rebuild-index") == 0) {
+      rebuild_index = true;
+    } else if (std::string(argv[i]).compare("--variable") == 0) {
+      search_options.variable = true;
+    } else if (std::string(argv[i]).compare("--exact") == 0) {
+      search_options.exact = true;
+    } else if (std::string(argv[i]).compare("--contains") == 0) {
+      search_options.contains = true;
+    } else if (std::string(argv[i]).compare("--no-daemon") == 0) {
+      use_daemon = false;
+    } else if (std::string(argv[i]).compare("--prefer") == 0) {
+      if (i + 1 < argc) {
+        std::string cur = std::string(argv[i + 1]);
+        if (!registry.has(cur)) {
+          std::string valid;
+          for (const auto &name : registry.names()) {
+            valid += (valid.empty() ? "" : ", ") + name;
+          }
+          std::cout << "Error: --prefer supplied without a valid argument\n"
+                    << "Valid arguments are: " << valid << std::endl;
+          exit(15);
+        }
+        registry.prefer(cur);
+      } else {
+        std::cout << "Error: --prefer supplied without an argument" << std::endl;
+        exit(16);
+      }
+      i++;
+    } else if (std::string(argv[i]).compare("--jobs") == 0) {
+      if (i + 1 < argc) {
+        if (!faf::Downloader::parse_jobs(argv[i + 1], jobs)) {
+          std::cout << "Error: --jobs supplied without a valid argument\n"
+                    << "Valid arguments are numbers from 1 to "
+                    << faf::Downloader::MAX_JOBS << std::endl;
+          exit(15);
+        }
+      } else {
+        std::cout << "Error: --jobs supplied without an argument" << std::endl;
+        exit(16);
+      }
+      i++;
+    } else if (std::string(argv[i]).compare("--limit-rate") == 0) {
+      if (i + 1 < argc) {
+        if (!faf::RateLimit::parse(argv[i + 1], limit_rate)) {
+          std::cout << "Error: --limit-rate supplied without a valid argument\n"
+                    << "Valid arguments are bytes per second, like 500K or 2M" << std::endl;
+          exit(15);
+        }
+        faf::RateLimit::get().set(limit_rate);
+      } else {
+        std::cout << "Error: --limit-rate supplied without an argument" << std::endl;
+        exit(16);
+      }
+      i++;
+    } else if (std::string(argv[i]).compare("--subset") == 0) {
+      if (i + 1 < argc) {
+        if (!faf::Subsetter::parse_ranges(argv[i + 1], subset)) {
+          std::cout << "Error: --subset supplied without a valid argument\n"
+                    << "Valid arguments are unicode ranges, like U+0-7F,U+A0-FF,U+20AC"
+                    << std::endl;
+          exit(15);
+        }
+      } else {
+        std::cout << "Error: --subset supplied without an argument" << std::endl;
+        exit(16);
+      }
+      i++;
     } else if (std::string(argv[i]).compare("--attend") == 0) {
-      if (std::vector<std::string>(argv + 1, argv + argc).size() > i) {
+      if (i + 1 < argc) {
         size_t pos = 0;
 
         std::string cur = std::string(argv[i + 1]);
@@ -182,23 +506,100 @@ int main(int argc, char *argv[]) {
         exit(16);
       }
       i++;
-    } else {
-      auto arg = std::string(argv[i]);
-      std::transform(arg.begin(), arg.end(), arg.begin(),
-                     [](unsigned char c) { return std::tolower(c); });
-      for (int i = 0; i < arg.size(); i++) {
-        if (arg[i] == '-') {
-          arg[i] = ' ';
+    } else if (std::string(argv[i]).compare("--from") == 0) {
+      if (i + 1 < argc) {
+        std::string data;
+        if (!faf::Util::read_file(argv[i + 1], data)) {
+          std::cout << "Error: could not read '" << argv[i + 1] << "'" << std::endl;
+          exit(15);
         }
+
+        if (faf::Lockfile::is_lockfile(data)) {
+          if (!faf::Lockfile::read(data, pinned, pinned_strings)) {
+            std::cout << "Error: '" << argv[i + 1] << "' is not a valid lockfile"
+                      << std::endl;
+            exit(15);
+          }
+          for (const auto &font : pinned) {
+            if (!std::count(items.begin(), items.end(), font.name)) {
+              add_item(std::string(font.name));
+            }
+          }
+        } else {
+          // One font per line, blank lines and # comments are skipped
+          std::istringstream stream(data);
+          std::string line;
+          while (std::getline(stream, line)) {
+            line.erase(0, line.find_first_not_of(" \t\r"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty() && line[0] != '#') {
+              add_item(line);
+            }
+          }
+        }
+      } else {
+        std::cout << "Error: --from supplied without an argument" << std::endl;
+        exit(16);
       }
-      items.push_back(arg);
+      i++;
+    } else if (std::string(argv[i]).compare("--timings") == 0) {
+      show_timings = true;
+    } else if (std::string(argv[i]).compare("--trace") == 0) {
+      if (i + 1 < argc) {
+        trace_path = argv[i + 1];
+      } else {
+        std::cout << "Error: --trace supplied without an argument" << std::endl;
+        exit(16);
+      }
+      i++;
+    } else if (std::string(argv[i]).compare("--lock") == 0) {
+      if (i + 1 < argc) {
+        lock_path = argv[i + 1];
+      } else {
+        std::cout << "Error: --lock supplied without an argument" << std::endl;
+        exit(16);
+      }
+      i++;
+    } else {
+      add_item(argv[i]);
+    }
+  }
+
+  // A mirror is only as good as the catalogs it was made from
+  if (cur_mode == MODE::MIRROR && cache_policy == faf::CACHE_POLICY::DEFAULT) {
+    cache_policy = faf::CACHE_POLICY::REFRESH;
+  }
+  faf::CatalogCache::configure(cache_ttl, cache_policy);
+
+  // Made up front, so a courier asking for its configuration asks before searching
+  const auto couriers_start = faf::timing_clock::now();
+  for (const auto &name : registry.enabled()) {
+    registry.get(name);
+  }
+  faf::Timings::record("courier construction", "setup", couriers_start);
+
+  if (rebuild_index) {
+    bool rebuilt = true;
+    for (const auto &name : registry.enabled()) {
+      rebuilt = registry.get(name)->rebuild_index() && rebuilt;
+    }
+
+    if (!rebuilt) {
+      std::cout << "\033[91mError: could not rebuild the catalog index\n\033[0m";
+      exit(1);
+    }
+    std::cout << "Rebuilt the catalog index" << std::endl;
+
+    if (mode_supplied == 0) {
+      return 0;
     }
   }
 
   if (mode_supplied > 1) {
     std::cout << "Error: Only one operation can be used at a time" << std::endl;
     exit(11);
-  } else if (items.empty()) {
+  } else if (items.empty() && cur_mode != MODE::LIST && cur_mode != MODE::UPDATE &&
+             cur_mode != MODE::MIRROR) {
     std::cout << "Error: No fonts specified (use -h for help)" << std::endl;
     exit(13);
   } else if (mode_supplied == 0) {
@@ -206,45 +607,46 @@ int main(int argc, char *argv[]) {
     exit(12);
   }
 
+  // fafd installs whole fonts for its own user with the cache as it is and at its own
+  // rate, anything else is done here
+  faf::DaemonClient daemon;
+  if (use_daemon && (cur_mode == MODE::SEARCH || cur_mode == MODE::DOWNLOAD) && !system_wide &&
+      cache_policy == faf::CACHE_POLICY::DEFAULT && limit_rate == 0 && subset.empty()) {
+    daemon.connect();
+  }
+
   switch (cur_mode) {
   case MODE::SEARCH: {
-    std::vector<faf::font_props> res;
-    bool is_fs = false;
-    if (!no_google) {
-      res = gfonts.search(items);
-      if (res.empty()) {
-        res = fontsquirrel.search(items);
-        is_fs = true;
-      }
-    } else {
-      res = fontsquirrel.search(items);
-      is_fs = true;
-    }
+    std::vector<faf::font_props> res =
+        search_all(registry, daemon, items, search_options);
     std::string cur_font_name;
+    bool cur_is_fs = false;
     int i;
     bool has_italic = false;
     bool has_regular = false;
     for (const auto &font : res) {
       if (font.name != cur_font_name) {
+        bool is_fs = font.source == "fontsquirrel";
+        std::cout << (cur_font_name.empty() ? ""
+                      : cur_is_fs
+                          ? "\n"
+                          : std::string("\nVariants:") +
+                                (has_regular ? has_italic ? " regular," : " regular"
+                                             : "") +
+                                (has_italic ? " italic" : "") + "\n\n");
         if (!is_fs) {
-          std::cout << (cur_font_name.empty()
-                            ? ""
-                            : std::string("\nVariants:") +
-                                  (has_regular ? has_italic ? " regular," : " regular"
-                                               : "") +
-                                  (has_italic ? " italic" : "") + "\n\n")
-                    << "\033[92mFound:    " << font.name << "\033[0m\n"
+          std::cout << "\033[92mFound:    " << font.name << "\033[0m\n"
                     << "\nWeights:  "
                     << (font.weight.find("italic") != std::string::npos ? ""
                                                                         : font.weight)
                     << " ";
         } else {
-          std::cout << (cur_font_name.empty() ? "" : "\n")
-                    << "\033[92mFound:    " << font.name << "\033[0m\n";
+          std::cout << "\033[92mFound:    " << font.name << "\033[0m\n";
         }
 
         has_regular = false;
         has_italic = false;
+        cur_is_fs = is_fs;
         i = 1;
       } else {
         if (font.prop.find("italic") != std::string::npos) {
@@ -262,7 +664,7 @@ int main(int argc, char *argv[]) {
       }
       cur_font_name = font.name;
     }
-    if (!is_fs) {
+    if (!cur_font_name.empty() && !cur_is_fs) {
       std::cout << std::string("\nVariants:") +
                        (has_regular ? has_italic ? " regular," : " regular" : "") +
                        (has_italic ? " italic" : "")
@@ -273,21 +675,44 @@ int main(int argc, char *argv[]) {
   }
 
   case MODE::DOWNLOAD: {
-    bool is_fs = false;
+    // Pinned files are fetched as they are, without looking at any catalog
+    std::vector<faf::font_props> selected = pinned;
     std::vector<faf::font_props> res;
-    if (!no_google) {
-      res = gfonts.search(items);
-      if (res.empty()) {
-        res = fontsquirrel.search(items);
-        is_fs = true;
-      }
-    } else {
-      res = fontsquirrel.search(items);
-      is_fs = true;
+    if (pinned.empty()) {
+      res = search_all(registry, daemon, items, search_options);
     }
-    int dl = 0;
     for (const auto &font : res) {
-      if (!is_fs) {
+      if (font.max_weight != 0) {
+        // A variable font covers a whole range of weights with a single file
+        if (font.prop == "italic") {
+          if (ignore_italic) {
+            continue;
+          }
+        } else {
+          std::vector<int> wanted;
+          if (!ignore_regular) {
+            wanted.push_back(400);
+          }
+          if (!ignore_bold) {
+            wanted.push_back(700);
+          }
+          for (const auto &weight : extra_weights) {
+            int value = faf::Common::weight_value(weight);
+            if (value < font.min_weight || value > font.max_weight) {
+              std::cout << "\033[93mWarning: " << font.name << " only has weights "
+                        << font.weight << ", not " << weight << "\n\033[0m";
+            } else {
+              wanted.push_back(value);
+            }
+          }
+
+          if (std::none_of(wanted.begin(), wanted.end(), [&font](int value) {
+                return value >= font.min_weight && value <= font.max_weight;
+              })) {
+            continue;
+          }
+        }
+      } else if (font.source != "fontsquirrel") {
         if (ignore_regular && (font.weight != "bold" || !font.prop.ends_with("italic")) &&
             font.prop == "regular") {
           continue;
@@ -306,9 +731,22 @@ int main(int argc, char *argv[]) {
         }
       }
 
-      if (!faf::Common::download_font(font, system_wide)) {
-        std::cout << "\033[91mError: could not download font: '" << font.name
-                  << "'\n\033[0m";
+      selected.push_back(font);
+    }
+
+    std::vector<faf::download_result> results;
+    if (!daemon.is_connected() || !install_remote(daemon, selected, jobs, results)) {
+      faf::Downloader downloader(system_wide, jobs);
+      downloader.set_subset(subset);
+      results = downloader.download(selected);
+    }
+    print_subsets(results);
+
+    int dl = 0;
+    for (size_t i = 0; i < selected.size(); i++) {
+      if (!results[i].ok) {
+        std::cout << "\033[91mError: could not download font: '" << selected[i].name
+                  << "' (" << results[i].error << ")\n\033[0m";
       } else {
         dl++;
       }
@@ -317,27 +755,32 @@ int main(int argc, char *argv[]) {
       std::cout << "\033[93mNo fonts downloaded\033[0m" << std::endl;
     }
 
+    if (!lock_path.empty()) {
+      if (faf::Lockfile::write(lock_path, selected, results)) {
+        std::cout << "Wrote " << lock_path << std::endl;
+      } else {
+        std::cout << "\033[91mError: could not write '" << lock_path << "'\n\033[0m";
+      }
+    }
+
     break;
   }
 
   case MODE::REMOVE: {
     for (const auto &font : items) {
-      std::uintmax_t cnt;
+      std::uintmax_t cnt = 0;
 
       if (!ignore_regular && !ignore_italic && !ignore_bold) {
         cnt = faf::Common::remove_font_family(font, system_wide); // remove everything
       } else {
         if (!ignore_regular) {
-          faf::Common::remove_single_font(font, "regular", system_wide);
-          cnt++;
+          cnt += faf::Common::remove_single_font(font, "regular", system_wide);
         }
         if (!ignore_italic) {
-          faf::Common::remove_single_font(font, "italic", system_wide);
-          cnt++;
+          cnt += faf::Common::remove_single_font(font, "italic", system_wide);
         }
         if (!ignore_bold) {
-          faf::Common::remove_single_font(font, "bold", system_wide);
-          cnt++;
+          cnt += faf::Common::remove_single_font(font, "bold", system_wide);
         }
       }
 
@@ -352,9 +795,73 @@ int main(int argc, char *argv[]) {
     break;
   }
 
+  case MODE::LIST: {
+    faf::Manifest manifest(system_wide);
+    size_t listed = 0;
+
+    for (const auto &[family, files] : manifest.get_families()) {
+      if (!items.empty() &&
+          std::none_of(items.begin(), items.end(), [&family](const std::string &item) {
+            return faf::Manifest::family_name(item) == family;
+          })) {
+        continue;
+      }
+
+      std::cout << "\033[92mInstalled: " << family << "\033[0m ("
+                << files.front().source << ")\n";
+      for (const auto &entry : files) {
+        std::cout << "    " << std::filesystem::path(entry.path).filename().string() << "  "
+                  << entry.weight << "  " << (entry.size + 1023) / 1024 << " KiB\n";
+      }
+      listed++;
+    }
+
+    for (const auto &item : items) {
+      if (manifest.get_family(item).empty()) {
+        std::cout << "\033[91mError: font is not installed: '" << item << "'\n\033[0m";
+      }
+    }
+    if (items.empty() && listed == 0) {
+      std::cout << "\033[93mNo fonts installed\033[0m" << std::endl;
+    }
+
+    break;
+  }
+
+  case MODE::UPDATE: {
+    auto *gfonts = dynamic_cast<faf::Google *>(registry.get("google"));
+    const std::vector<std::string> enabled = registry.enabled();
+    if (!gfonts || std::find(enabled.begin(), enabled.end(), "google") == enabled.end()) {
+      std::cout << "\033[93mGoogle Fonts is disabled, nothing to update\033[0m" << std::endl;
+      break;
+    }
+    update_installed(*gfonts, items, system_wide, jobs, subset);
+    break;
+  }
+
+  case MODE::MIRROR: {
+    std::vector<faf::mirror_file> files;
+    bool ok = true;
+    for (const auto &name : registry.enabled()) {
+      ok = registry.get(name)->mirror_to(mirror_dir, items, files) && ok;
+    }
+
+    if (faf::Mirror::sync(mirror_dir, std::move(files), jobs) > 0 || !ok) {
+      exit(1);
+    }
+    break;
+  }
+
   case MODE::NONE:
     break;
   }
 
+  if (show_timings) {
+    faf::Timings::print_summary(std::cout);
+  }
+  if (!trace_path.empty() && !faf::Timings::write_trace(trace_path)) {
+    std::cout << "\033[91mError: could not write '" << trace_path << "'\n\033[0m";
+  }
+
   return 0;
 }
@@ -0,0 +1,211 @@
+#include "progress.h"
+
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// Often enough to look alive, rarely enough to cost nothing next to the transfers
+constexpr auto INTERVAL = std::chrono::milliseconds(100);
+// Bars shown at once, the rest is only part of the summary
+constexpr size_t MAX_BARS = 6;
+constexpr size_t BAR_WIDTH = 24;
+constexpr size_t LABEL_WIDTH = 24;
+
+const char *const SPINNER[] = {"◜", "◠", "◝", "◞", "◡", "◟"};
+
+std::string format_size(int64_t bytes) {
+  char buf[32];
+  if (bytes >= 1024 * 1024) {
+    std::snprintf(buf, sizeof(buf), "%.1f MiB", bytes / (1024.0 * 1024.0));
+  } else {
+    std::snprintf(buf, sizeof(buf), "%.1f KiB", bytes / 1024.0);
+  }
+  return buf;
+}
+
+std::string bar(int64_t received, int64_t total) {
+  const size_t filled =
+      total > 0 ? std::min<size_t>(BAR_WIDTH, received * BAR_WIDTH / total) : 0;
+  const int percent =
+      total > 0 ? static_cast<int>(std::min<int64_t>(100, received * 100 / total)) : 0;
+
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "] %3d%% ", percent);
+  return "[" + std::string(filled, '=') + std::string(BAR_WIDTH - filled, '-') + buf;
+}
+
+std::string fit(const std::string &label, size_t width) {
+  if (label.size() > width) {
+    return label.substr(0, width - 3) + "...";
+  }
+  return label + std::string(width - label.size(), ' ');
+}
+
+size_t terminal_width() {
+  winsize ws{};
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+    return ws.ws_col;
+  }
+  return 80;
+}
+
+void write_out(const std::string &text) {
+  std::fwrite(text.data(), 1, text.size(), stdout);
+  std::fflush(stdout);
+}
+
+} // namespace
+
+namespace faf {
+
+Progress::Progress(std::string title) : title(std::move(title)) {
+  const char *term = getenv("TERM");
+  enabled = isatty(STDOUT_FILENO) && !(term && std::strcmp(term, "dumb") == 0);
+
+  if (!enabled) {
+    return;
+  }
+
+  // Hide the cursor while drawing
+  write_out("\033[?25l");
+  renderer = std::thread([this]() { run(); });
+}
+
+Progress::~Progress() { stop(); }
+
+progress_item *Progress::add(std::string label) {
+  auto item = std::make_unique<progress_item>();
+  item->label = std::move(label);
+
+  std::lock_guard<std::mutex> guard(mutex);
+  items.push_back(std::move(item));
+  printed.push_back(false);
+  return items.back().get();
+}
+
+void Progress::expect(size_t count) {
+  std::lock_guard<std::mutex> guard(mutex);
+  expected = count;
+}
+
+void Progress::stop(const std::string &message) {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (stopping) {
+      return;
+    }
+    stopping = true;
+    cv.notify_all();
+  }
+
+  if (!enabled) {
+    return;
+  }
+  renderer.join();
+
+  std::string out = frame();
+  if (!message.empty()) {
+    out += "\033[92m✔\033[0m \033[1m" + message + "\033[0m\n";
+  }
+  write_out(out + "\033[?25h");
+}
+
+bool Progress::is_enabled() const { return enabled; }
+
+void Progress::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopping) {
+    lock.unlock();
+    write_out(frame());
+    lock.lock();
+    cv.wait_for(lock, INTERVAL, [this]() { return stopping; });
+  }
+}
+
+std::string Progress::frame() {
+  std::lock_guard<std::mutex> guard(mutex);
+  const size_t width = std::max<size_t>(terminal_width(), LABEL_WIDTH);
+
+  // Back to the top of what the last frame drew, and clear it
+  std::string out;
+  if (live_lines > 0) {
+    out += "\033[" + std::to_string(live_lines) + "F";
+  }
+  out += "\033[J";
+  live_lines = 0;
+
+  if (items.empty()) {
+    if (!stopping && !title.empty()) {
+      out += "\033[93;1m" + std::string(SPINNER[ticks++ % 6]) + "\033[0m \033[1m" + title +
+             "\033[0m\n";
+      live_lines = 1;
+    }
+    return out;
+  }
+
+  int64_t received = 0;
+  int64_t total = 0;
+  size_t done = 0;
+  size_t bars = 0;
+  std::string live;
+
+  for (size_t i = 0; i < items.size(); i++) {
+    const progress_item &item = *items[i];
+    const int64_t item_received = item.received.load(std::memory_order_relaxed);
+    const int64_t item_total = item.total.load(std::memory_order_relaxed);
+    const PROGRESS_STATE state = item.state.load(std::memory_order_relaxed);
+
+    received += item_received;
+    total += std::max(item_total, item_received);
+
+    if (state != PROGRESS_STATE::ACTIVE) {
+      done++;
+      // Finished items scroll up out of the redrawn part, once
+      if (!printed[i]) {
+        printed[i] = true;
+        const bool ok = state == PROGRESS_STATE::DONE;
+        out += std::string(ok ? "\033[92m✔\033[0m " : "\033[91m✖\033[0m ") +
+               fit(item.label, std::min(LABEL_WIDTH, width - 2)) + "\n";
+      }
+      continue;
+    }
+
+    if (++bars <= MAX_BARS && !stopping) {
+      std::string line = "  " + fit(item.label, LABEL_WIDTH) + " " +
+                         bar(item_received, item_total) + format_size(item_received);
+      live += line.substr(0, width - 1) + "\n";
+      live_lines++;
+    }
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  const double seconds = std::chrono::duration<double>(now - last_frame).count();
+  if (seconds > 0) {
+    rate = rate * 0.7 + (received - last_received) / seconds * 0.3;
+  }
+  last_received = received;
+  last_frame = now;
+
+  // A single transfer has its own bar already
+  const size_t count = std::max(expected, items.size());
+  if (count > 1 && !stopping) {
+    std::string line =
+        fit(std::to_string(done) + " of " + std::to_string(count) + " files",
+            LABEL_WIDTH + 2) +
+        " " + bar(received, total) + format_size(received) + "  " +
+        format_size(static_cast<int64_t>(rate)) + "/s";
+    live += line.substr(0, width - 1) + "\n";
+    live_lines++;
+  }
+
+  return out + live;
+}
+
+} // namespace faf
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace faf {
+
+enum class PROGRESS_STATE { ACTIVE, DONE, FAILED };
+
+// Counters of one transfer. They are only ever stored to by the transfer and read
+// by the renderer, so reporting progress costs a relaxed atomic store.
+struct progress_item {
+  std::string label;
+  std::atomic<int64_t> received{0};
+  // 0 while unknown
+  std::atomic<int64_t> total{0};
+  std::atomic<PROGRESS_STATE> state{PROGRESS_STATE::ACTIVE};
+};
+
+// Draws the progress of a run from its own thread, a few times a second, no
+// matter how often the counters change.
+//
+// Without items it is a spinner next to `title`. With items every finished one
+// gets a line of its own, the ones in flight a bar each below it, and once there
+// are more of them than fit a single bar sums them all up. Nothing is drawn when
+// stdout is not a terminal.
+class Progress {
+public:
+  explicit Progress(std::string title = "");
+  ~Progress();
+
+  Progress(const Progress &) = delete;
+  Progress &operator=(const Progress &) = delete;
+
+  // The item stays valid for the lifetime of this Progress
+  progress_item *add(std::string label);
+  // Number of items that will be added over time, for the summary
+  void expect(size_t count);
+
+  // Draws the final state and prints `message`, if any, as done
+  void stop(const std::string &message = "");
+
+  bool is_enabled() const;
+
+private:
+  void run();
+  // Everything below the lines already printed for good
+  std::string frame();
+
+  std::string title;
+  bool enabled;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping = false;
+  std::thread renderer;
+
+  std::vector<std::unique_ptr<progress_item>> items;
+  size_t expected = 0;
+  // Items whose final line is printed already
+  std::vector<bool> printed;
+  // Height of the part redrawn on every frame
+  size_t live_lines = 0;
+  size_t ticks = 0;
+
+  // For the transfer rate of the summary
+  int64_t last_received = 0;
+  std::chrono::steady_clock::time_point last_frame = std::chrono::steady_clock::now();
+  double rate = 0;
+};
+
+} // namespace faf
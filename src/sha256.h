@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace faf {
+
+// Incremental SHA-256, used to fingerprint the installed font files
+class Sha256 {
+public:
+  Sha256();
+
+  void update(const void *data, size_t size);
+  // Finishes the hash, the object must not be updated afterwards
+  std::string hex_digest();
+
+  // Hash of a whole file, empty if it can't be read
+  static std::string file(const std::filesystem::path &path);
+
+private:
+  void transform(const uint8_t *block);
+
+  uint32_t state[8];
+  uint64_t length = 0;
+  uint8_t buffer[64];
+  size_t buffered = 0;
+};
+
+} // namespace faf
@@ -0,0 +1,52 @@
+#include "string_arena.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+} // namespace
+
+namespace faf {
+
+std::string_view StringArena::store(std::string_view s) {
+  std::lock_guard<std::mutex> guard(mutex);
+
+  auto it = strings.find(s);
+  if (it != strings.end()) {
+    return *it;
+  }
+
+  const std::string_view stored = copy(s);
+  strings.insert(stored);
+  return stored;
+}
+
+size_t StringArena::capacity() const {
+  std::lock_guard<std::mutex> guard(mutex);
+  return total;
+}
+
+std::string_view StringArena::copy(std::string_view s) {
+  if (s.empty()) {
+    return {};
+  }
+
+  if (blocks.empty() || block_size - block_used < s.size()) {
+    // Strings longer than a block get one of their own
+    block_size = std::max(BLOCK_SIZE, s.size());
+    blocks.push_back(std::make_unique<char[]>(block_size));
+    block_used = 0;
+    total += block_size;
+  }
+
+  char *data = blocks.back().get() + block_used;
+  std::memcpy(data, s.data(), s.size());
+  block_used += s.size();
+
+  return {data, s.size()};
+}
+
+} // namespace faf
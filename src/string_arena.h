@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace faf {
+
+// Append-only storage for strings that many records point at. Each distinct
+// string is stored once, and the views store() hands out stay valid for the
+// lifetime of the arena. Safe to use from several threads.
+class StringArena {
+public:
+  StringArena() = default;
+
+  StringArena(const StringArena &) = delete;
+  StringArena &operator=(const StringArena &) = delete;
+
+  std::string_view store(std::string_view s);
+
+  // Bytes held, including the unused end of the current block
+  size_t capacity() const;
+
+private:
+  std::string_view copy(std::string_view s);
+
+  mutable std::mutex mutex;
+  std::vector<std::unique_ptr<char[]>> blocks;
+  size_t block_used = 0;
+  size_t block_size = 0;
+  size_t total = 0;
+  std::unordered_set<std::string_view> strings;
+};
+
+} // namespace faf
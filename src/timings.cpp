@@ -0,0 +1,157 @@
+#include "timings.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <thread>
+
+#include "external/nlohmann/json.hpp"
+#include "util.h"
+
+namespace faf {
+using json = nlohmann::json;
+
+std::atomic<bool> Timings::enabled{false};
+std::mutex Timings::mutex;
+timing_clock::time_point Timings::origin = timing_clock::now();
+std::vector<Timings::event> Timings::events;
+std::vector<Timings::transfer> Timings::transfers;
+
+void Timings::enable() { enabled.store(true); }
+
+void Timings::record(const std::string &name, const std::string &category,
+                     timing_clock::time_point start,
+                     const std::map<std::string, double> &args) {
+  if (!enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  const auto end = timing_clock::now();
+  const size_t thread = thread_id();
+
+  std::lock_guard<std::mutex> guard(mutex);
+  events.push_back({name, category, start, end - start, thread, args});
+}
+
+void Timings::record_transfer(const std::string &name, CURL *handle) {
+  if (!enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  // libcurl reports every phase as time since the start of the transfer
+  curl_off_t namelookup = 0, connect = 0, appconnect = 0, starttransfer = 0, total = 0;
+  curl_off_t bytes = 0, speed = 0;
+  curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+  curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+  curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+  curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+  curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+  curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+  curl_easy_getinfo(handle, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+
+  const auto start = timing_clock::now() - std::chrono::microseconds(total);
+  const auto ms = [](curl_off_t us) { return us / 1000.0; };
+
+  record(name, "transfer", start,
+         {{"namelookup_ms", ms(namelookup)},
+          {"connect_ms", ms(connect)},
+          {"appconnect_ms", ms(appconnect)},
+          {"starttransfer_ms", ms(starttransfer)},
+          {"bytes", double(bytes)},
+          {"speed_bps", double(speed)}});
+
+  std::lock_guard<std::mutex> guard(mutex);
+  transfers.push_back({name, ms(namelookup), ms(connect), ms(appconnect), ms(starttransfer),
+                       ms(total), bytes, speed});
+}
+
+void Timings::print_summary(std::ostream &out) {
+  std::lock_guard<std::mutex> guard(mutex);
+
+  // Totals per phase, in the order the phases first ran
+  std::vector<std::string> order;
+  std::map<std::string, std::pair<size_t, double>> totals;
+  for (const auto &e : events) {
+    if (e.category == "transfer") {
+      continue;
+    }
+    if (!totals.count(e.name)) {
+      order.push_back(e.name);
+    }
+    auto &[count, total] = totals[e.name];
+    count++;
+    total += std::chrono::duration<double, std::milli>(e.duration).count();
+  }
+
+  out << std::fixed << std::setprecision(1) << "\nTimings:\n";
+  for (const auto &name : order) {
+    const auto &[count, total] = totals[name];
+    out << "    " << std::left << std::setw(32) << name << std::right << std::setw(10)
+        << total << " ms";
+    if (count > 1) {
+      out << "  (" << count << "x)";
+    }
+    out << "\n";
+  }
+
+  if (!transfers.empty()) {
+    out << "\nTransfers:                        dns   connect       tls     first     total"
+           "        KiB     KiB/s\n";
+    for (const auto &t : transfers) {
+      std::string name = t.name.size() > 28 ? "..." + t.name.substr(t.name.size() - 25) : t.name;
+      out << "    " << std::left << std::setw(28) << name << std::right << std::setw(8)
+          << t.namelookup << std::setw(10) << t.connect << std::setw(10) << t.appconnect
+          << std::setw(10) << t.starttransfer << std::setw(10) << t.total << std::setw(11)
+          << t.bytes / 1024.0 << std::setw(10) << t.speed / 1024.0 << "\n";
+    }
+    out << "    (ms since the start of each transfer)\n";
+  }
+
+  out << std::defaultfloat;
+}
+
+bool Timings::write_trace(const std::filesystem::path &path) {
+  std::lock_guard<std::mutex> guard(mutex);
+
+  json trace = json::array();
+  const auto pid = getpid();
+  const auto us = [](auto d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+  };
+
+  for (const auto &e : events) {
+    json args = json::object();
+    for (const auto &[key, value] : e.args) {
+      args[key] = value;
+    }
+    trace.push_back({{"name", e.name},
+                     {"cat", e.category},
+                     {"ph", "X"},
+                     {"ts", us(e.start - origin)},
+                     {"dur", us(e.duration)},
+                     {"pid", pid},
+                     {"tid", e.thread},
+                     {"args", args}});
+  }
+
+  return Util::write_file(path, json({{"traceEvents", trace}}).dump() + "\n");
+}
+
+Timings::Span::Span(std::string name, std::string category)
+    : name(std::move(name)), category(std::move(category)), start(timing_clock::now()) {}
+
+Timings::Span::~Span() { record(name, category, start); }
+
+size_t Timings::thread_id() {
+  // Small stable numbers read better in a trace viewer than native ids
+  static std::mutex ids_mutex;
+  static std::map<std::thread::id, size_t> ids;
+
+  std::lock_guard<std::mutex> guard(ids_mutex);
+  auto [it, inserted] = ids.try_emplace(std::this_thread::get_id(), ids.size() + 1);
+  return it->second;
+}
+
+} // namespace faf
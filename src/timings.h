@@ -0,0 +1,81 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace faf {
+
+using timing_clock = std::chrono::steady_clock;
+
+// Where the time of a run goes, shown by --timings and written out by --trace.
+//
+// Phases are recorded as spans, and every transfer with the breakdown libcurl
+// measured for it. Nothing is recorded until enable() is called, so a process
+// that never reports them, like fafd, doesn't collect them forever.
+class Timings {
+public:
+  static void enable();
+
+  // Records the phase `name` from `start` until now
+  static void record(const std::string &name, const std::string &category,
+                     timing_clock::time_point start,
+                     const std::map<std::string, double> &args = {});
+  // Records a finished transfer of `name` with the timings of `handle`
+  static void record_transfer(const std::string &name, CURL *handle);
+
+  // Human readable totals per phase and a table of the transfers
+  static void print_summary(std::ostream &out);
+  // Chrome trace event JSON, for chrome://tracing or Perfetto
+  static bool write_trace(const std::filesystem::path &path);
+
+  // Records the enclosing scope as a phase
+  class Span {
+  public:
+    Span(std::string name, std::string category);
+    ~Span();
+
+  private:
+    std::string name;
+    std::string category;
+    timing_clock::time_point start;
+  };
+
+private:
+  struct event {
+    std::string name;
+    std::string category;
+    timing_clock::time_point start;
+    timing_clock::duration duration;
+    size_t thread;
+    std::map<std::string, double> args;
+  };
+
+  struct transfer {
+    std::string name;
+    double namelookup;
+    double connect;
+    double appconnect;
+    double starttransfer;
+    double total;
+    curl_off_t bytes;
+    curl_off_t speed;
+  };
+
+  static size_t thread_id();
+
+  static std::atomic<bool> enabled;
+  static std::mutex mutex;
+  static timing_clock::time_point origin;
+  static std::vector<event> events;
+  static std::vector<transfer> transfers;
+};
+
+} // namespace faf
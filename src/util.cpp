@@ -2,12 +2,70 @@
 #include <unistd.h>
 #include <pwd.h>
 
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
 namespace faf {
 
 std::string Util::get_home_dir() {
+  // $HOME comes first like in most tools, so faf can be run against another home
+  const char *home = std::getenv("HOME");
+  if (home && *home) {
+    return home;
+  }
+
   struct passwd *pw = getpwuid(getuid());
   return std::string(pw->pw_dir);
 }
 
+std::filesystem::path Util::get_cache_dir() {
+  return std::filesystem::path(get_home_dir()) / ".cache" / "faf";
+}
+
+std::filesystem::path Util::get_data_dir() {
+  return std::filesystem::path(get_home_dir()) / ".local" / "share" / "faf";
+}
+
+bool Util::read_file(const std::filesystem::path &path, std::string &out) {
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream) {
+    return false;
+  }
+  out.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+  return true;
+}
+
+std::filesystem::path Util::temp_path(const std::filesystem::path &path,
+                                      const std::string &suffix) {
+  static std::atomic<unsigned> counter{0};
+  std::filesystem::path tmp = path;
+  tmp += suffix + "." + std::to_string(getpid()) + "." + std::to_string(counter++);
+  return tmp;
+}
+
+bool Util::write_file(const std::filesystem::path &path, const std::string &data) {
+  const std::filesystem::path tmp = temp_path(path, ".tmp");
+  std::error_code ec;
+  {
+    std::ofstream stream(tmp, std::ios::binary | std::ios::trunc);
+    if (!stream) {
+      return false;
+    }
+    stream.write(data.data(), data.size());
+    stream.close();
+    if (!stream) {
+      std::filesystem::remove(tmp, ec);
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+  }
+  return !ec;
+}
+
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <filesystem>
 #include <string>
 
 namespace faf {
@@ -7,6 +8,15 @@ namespace faf {
 class Util {
 public:
   static std::string get_home_dir();
+  static std::filesystem::path get_cache_dir();
+  static std::filesystem::path get_data_dir();
+
+  static bool read_file(const std::filesystem::path &path, std::string &out);
+  // A name next to `path` no other writer, thread or process, uses at the same time
+  static std::filesystem::path temp_path(const std::filesystem::path &path,
+                                         const std::string &suffix);
+  // Writes to a temporary file first, so readers never see a partial file
+  static bool write_file(const std::filesystem::path &path, const std::string &data);
 };
 
 }